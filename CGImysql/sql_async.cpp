@@ -0,0 +1,313 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "sql_async.h"
+#include "../http/http_conn.h"
+
+sql_async::sql_async() : m_epollfd(-1), m_eventfd(-1), m_started(false), m_stop(false),
+                         m_resume(NULL), m_arg(NULL), m_close_log(0)
+{
+}
+
+sql_async *sql_async::GetInstance()
+{
+	static sql_async sqlAsync;
+	return &sqlAsync;
+}
+
+void sql_async::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log,
+                     resume_func resume, void *arg)
+{
+	m_close_log = close_log;
+	m_resume = resume;
+	m_arg = arg;
+
+	m_epollfd = epoll_create(5);
+	m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_epollfd < 0 || m_eventfd < 0)
+	{
+		LOG_ERROR("%s", "sql_async: create epoll/eventfd failed");
+		exit(1);
+	}
+	epoll_event event;
+	event.data.ptr = NULL;
+	event.events = EPOLLIN;
+	epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_eventfd, &event);
+
+	m_url = url;
+	m_User = User;
+	m_PassWord = PassWord;
+	m_DatabaseName = DBName;
+	m_Port = Port;
+
+	// 先分配所有slot再取地址，之后m_slots不再扩容；未能建立的连接在第一次使用时重新连接
+	m_slots.resize(MaxConn);
+	for (int i = 0; i < MaxConn; i++)
+	{
+		slot *s = &m_slots[i];
+		s->ret = 0;
+		s->timeout_us = 0;
+		connect(s);
+		m_idle.push_back(s);
+	}
+
+	if (pthread_create(&m_thread, NULL, worker, this) != 0)
+	{
+		LOG_ERROR("%s", "sql_async: create thread failed");
+		exit(1);
+	}
+	m_started = true;
+}
+
+void sql_async::submit(http_conn *request, SQL_STATEMENT stmt, const char **params, int num)
+{
+	// 查询完成、结果写回之前连接对象不被复用，sql_done检查代数之后写回的仍是同一个连接
+	request->hold();
+	task t;
+	t.request = request;
+	t.generation = request->get_generation();
+	t.stmt = stmt;
+	t.num = num < SQL_MAX_PARAMS ? num : SQL_MAX_PARAMS;
+	for (int i = 0; i < t.num; i++)
+		t.params[i] = params[i];
+	t.submit_us = stats::now_us();
+	t.retried = false;
+	stats::get_instance()->add(stats::SQL_ASYNC);
+
+	// 队列由空变为非空时才需要唤醒，其余情况查询线程必然还会来取
+	m_lock.lock();
+		bool need_wakeup = m_submitted.empty();
+		m_submitted.push_back(t);
+	m_lock.unlock();
+
+	if (need_wakeup)
+	{
+		uint64_t one = 1;
+		::write(m_eventfd, &one, sizeof(one));
+	}
+}
+
+void sql_async::stop()
+{
+	if (!m_started)
+		return;
+	m_stop = true;
+	uint64_t one = 1;
+	::write(m_eventfd, &one, sizeof(one));
+	pthread_join(m_thread, NULL);
+	m_started = false;
+}
+
+sql_async::~sql_async()
+{
+	stop();
+	for (size_t i = 0; i < m_slots.size(); ++i)
+	{
+		for (int j = 0; j < STMT_NUM; j++)
+			if (m_slots[i].stmts[j])
+				mysql_stmt_close(m_slots[i].stmts[j]);
+		mysql_close(m_slots[i].conn);
+	}
+	if (m_epollfd >= 0)
+		close(m_epollfd);
+	if (m_eventfd >= 0)
+		close(m_eventfd);
+}
+
+void *sql_async::worker(void *arg)
+{
+	sql_async *sqlAsync = (sql_async *)arg;
+	mysql_thread_init();
+	sqlAsync->run();
+	mysql_thread_end();
+	return NULL;
+}
+
+void sql_async::run()
+{
+	epoll_event events[MAX_EVENTS];
+	while (!m_stop)
+	{
+		int number = epoll_wait(m_epollfd, events, MAX_EVENTS, next_timeout());
+		if (number < 0 && errno != EINTR)
+		{
+			LOG_ERROR("%s", "sql_async: epoll failure");
+			break;
+		}
+
+		for (int i = 0; i < number; i++)
+		{
+			slot *s = (slot *)events[i].data.ptr;
+			// 新提交的查询，与内部队列交换后排在等待连接的查询之后
+			if (!s)
+			{
+				uint64_t cnt;
+				::read(m_eventfd, &cnt, sizeof(cnt));
+				list<task> submitted;
+				m_lock.lock();
+					submitted.swap(m_submitted);
+				m_lock.unlock();
+				m_pending.splice(m_pending.end(), submitted);
+				continue;
+			}
+
+			// 出错时也交给客户端库，由它报告查询失败
+			int status = 0;
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				status |= MYSQL_WAIT_READ;
+			if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+				status |= MYSQL_WAIT_WRITE;
+			if (events[i].events & EPOLLPRI)
+				status |= MYSQL_WAIT_EXCEPT;
+			wait(s, mysql_stmt_execute_cont(&s->ret, s->stmts[s->t.stmt], status));
+		}
+
+		long long now = stats::now_us();
+		for (size_t i = 0; i < m_slots.size(); ++i)
+		{
+			slot *s = &m_slots[i];
+			if (s->timeout_us && now >= s->timeout_us)
+				wait(s, mysql_stmt_execute_cont(&s->ret, s->stmts[s->t.stmt], MYSQL_WAIT_TIMEOUT));
+		}
+
+		while (!m_idle.empty() && !m_pending.empty())
+			start(m_idle.back());
+	}
+}
+
+void sql_async::start(slot *s)
+{
+	m_idle.pop_back();
+	s->t = m_pending.front();
+	m_pending.pop_front();
+
+	// 上次未能重新连接的，取用时再试一次
+	if (!s->stmts[s->t.stmt])
+		reconnect(s);
+
+	// 参数指向任务中的字符串，执行期间保持不变
+	MYSQL_STMT *stmt = s->stmts[s->t.stmt];
+	const char *params[SQL_MAX_PARAMS];
+	for (int i = 0; i < s->t.num; i++)
+		params[i] = s->t.params[i].c_str();
+	if (!stmt || !bind_params(stmt, s->bind, s->lengths, params, s->t.num))
+	{
+		s->ret = 1;
+		finish(s);
+		return;
+	}
+	wait(s, mysql_stmt_execute_start(&s->ret, stmt));
+}
+
+void sql_async::wait(slot *s, int status)
+{
+	s->timeout_us = 0;
+	if (0 == status)
+	{
+		finish(s);
+		return;
+	}
+
+	epoll_event event;
+	event.data.ptr = s;
+	event.events = EPOLLONESHOT;
+	if (status & MYSQL_WAIT_READ)
+		event.events |= EPOLLIN;
+	if (status & MYSQL_WAIT_WRITE)
+		event.events |= EPOLLOUT;
+	if (status & MYSQL_WAIT_EXCEPT)
+		event.events |= EPOLLPRI;
+	epoll_ctl(m_epollfd, EPOLL_CTL_MOD, s->fd, &event);
+	if (status & MYSQL_WAIT_TIMEOUT)
+		s->timeout_us = stats::now_us() + (long long)mysql_get_timeout_value_ms(s->conn) * 1000;
+}
+
+void sql_async::finish(slot *s)
+{
+	task t = s->t;
+	m_idle.push_back(s);
+
+	if (s->ret)
+	{
+		MYSQL_STMT *stmt = s->stmts[t.stmt];
+		unsigned int err = stmt ? mysql_stmt_errno(stmt) : 0;
+		LOG_ERROR("sql_async: query error:%s", stmt ? mysql_stmt_error(stmt) : "statement not prepared");
+		if (connection_lost(err))
+		{
+			reconnect(s);
+			// 语句未发出(CR_SERVER_GONE_ERROR)时在新连接上重试一次；CR_SERVER_LOST时可能已执行，按失败返回
+			if (CR_SERVER_GONE_ERROR == err && !t.retried && s->stmts[t.stmt])
+			{
+				t.retried = true;
+				m_pending.push_front(t);
+				return;
+			}
+		}
+	}
+	stats::get_instance()->observe(stats::SQL_QUERY_US, stats::now_us() - t.submit_us);
+	// 连接在查询期间已关闭时丢弃结果
+	if (t.request->sql_done(t.generation, s->ret))
+		m_resume(t.request, t.generation, m_arg);
+	t.request->leave();
+}
+
+bool sql_async::connect(slot *s)
+{
+	for (int i = 0; i < STMT_NUM; i++)
+		s->stmts[i] = NULL;
+	s->fd = -1;
+	s->conn = mysql_init(NULL);
+	if (s->conn == NULL)
+	{
+		LOG_ERROR("MySQL Error: mysql_init() returns NULL");
+		exit(1);
+	}
+	// 连接本身仍以阻塞方式建立，只有查询走非阻塞接口；读写超时时客户端库返回MYSQL_WAIT_TIMEOUT
+	mysql_options(s->conn, MYSQL_OPT_NONBLOCK, 0);
+	set_timeouts(s->conn);
+	if (mysql_real_connect(s->conn, m_url.c_str(), m_User.c_str(), m_PassWord.c_str(), m_DatabaseName.c_str(), m_Port, NULL, 0) == NULL)
+	{
+		string err_info( mysql_error(s->conn) );
+		err_info = (string("MySQL Error[errno=")
+			+ std::to_string(mysql_errno(s->conn)) + string("]: ") + err_info);
+		LOG_ERROR( err_info.c_str() );
+		return false;
+	}
+
+	prepare_statements(s->conn, s->stmts, m_close_log);
+
+	// 先以不关注任何事件的方式注册，每次等待时再按需修改
+	s->fd = mysql_get_socket(s->conn);
+	epoll_event event;
+	event.data.ptr = s;
+	event.events = EPOLLONESHOT;
+	epoll_ctl(m_epollfd, EPOLL_CTL_ADD, s->fd, &event);
+	return true;
+}
+
+void sql_async::reconnect(slot *s)
+{
+	// 关闭socket时自动从epoll中移除
+	for (int i = 0; i < STMT_NUM; i++)
+		if (s->stmts[i])
+			mysql_stmt_close(s->stmts[i]);
+	mysql_close(s->conn);
+	if (connect(s))
+	{
+		stats::get_instance()->add(stats::SQL_RECONNECT);
+		LOG_INFO("%s", "sql_async: MySQL reconnected");
+	}
+}
+
+int sql_async::next_timeout()
+{
+	long long next = 0;
+	for (size_t i = 0; i < m_slots.size(); ++i)
+		if (m_slots[i].timeout_us && (!next || m_slots[i].timeout_us < next))
+			next = m_slots[i].timeout_us;
+	if (!next)
+		return -1;
+	long long ms = (next - stats::now_us() + 999) / 1000;
+	return ms > 0 ? (int)ms : 0;
+}
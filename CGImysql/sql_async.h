@@ -0,0 +1,103 @@
+#ifndef _SQL_ASYNC_
+#define _SQL_ASYNC_
+
+#include <stdio.h>
+#include <list>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include "../lock/locker.h"
+#include "../log/log.h"
+#include "../stats/stats.h"
+#include "sql_connection_pool.h"
+
+using namespace std;
+
+class http_conn;
+
+// 非阻塞数据库查询：用客户端库的非阻塞接口(mysql_stmt_execute_start/_cont，MariaDB Connector/C提供)
+// 执行各连接上预编译的语句，一个查询线程在自己的epoll中监听所有数据库连接的socket，同时推进多条查询。
+// 工作线程提交查询后即交出请求，不等待数据库；查询完成时结果写回请求，由回调交还线程池从do_request继续。
+// 只用于不返回结果集的语句(注册时的INSERT)
+class sql_async
+{
+public:
+    // 查询完成、请求仍然有效时在查询线程上调用，generation为提交时请求所属连接的代数
+    typedef void (*resume_func)(http_conn *request, unsigned int generation, void *arg);
+
+    //单例模式
+    static sql_async *GetInstance();
+
+    // 建立MaxConn个非阻塞连接并启动查询线程
+    void init(string url, string User, string PassWord, string DataBaseName, int Port, int MaxConn, int close_log,
+              resume_func resume, void *arg);
+    // 工作线程调用：参数在提交时复制，提交后不能再访问request，查询完成时由resume交还
+    void submit(http_conn *request, SQL_STATEMENT stmt, const char **params, int num);
+    // 停止查询线程，未完成的查询不再交还请求，在线程池销毁前调用
+    void stop();
+
+private:
+    static const int MAX_EVENTS = 64;
+
+    struct task
+    {
+        http_conn*    request;
+        unsigned int  generation;  // 提交时请求所属连接的代数，连接在查询期间关闭时不再交还
+        SQL_STATEMENT stmt;
+        string        params[SQL_MAX_PARAMS];
+        int           num;
+        long long     submit_us;
+        bool          retried;     // 连接断开后已在新连接上重试过
+    };
+
+    // 一个非阻塞连接及其上正在进行的查询
+    struct slot
+    {
+        MYSQL*        conn;
+        int           fd;
+        MYSQL_STMT*   stmts[STMT_NUM];   // 该连接上预编译的语句，连接断开且未能重新连接时为NULL
+        MYSQL_BIND    bind[SQL_MAX_PARAMS];
+        unsigned long lengths[SQL_MAX_PARAMS];
+        task          t;
+        int           ret;         // mysql_stmt_execute的返回值
+        long long     timeout_us;  // 客户端库要求的超时时刻，不需要超时为0
+    };
+
+    sql_async();
+    ~sql_async();
+
+    static void *worker(void *arg);
+    void run();
+    void start(slot *s);              // 在空闲连接上开始下一条排队的查询
+    void wait(slot *s, int status);   // 按客户端库返回的等待状态注册事件，status为0时查询已完成
+    void finish(slot *s);
+    bool connect(slot *s);            // 建立非阻塞连接、准备语句并注册到epoll，失败时语句为NULL
+    void reconnect(slot *s);          // 连接断开时关闭后重新建立，由查询线程在连接空闲时调用
+    int next_timeout();               // 距最近的超时时刻的毫秒数，没有为-1
+
+    int                 m_epollfd;
+    int                 m_eventfd;    // 提交查询、停止时唤醒查询线程
+    pthread_t           m_thread;
+    bool                m_started;
+    std::atomic<bool>   m_stop;
+
+    locker              m_lock;
+    list<task>          m_submitted;  // 已提交、查询线程尚未取走的查询，由m_lock保护
+    list<task>          m_pending;    // 以下只由查询线程访问：等待空闲连接的查询
+    vector<slot>        m_slots;
+    vector<slot*>       m_idle;
+
+    string              m_url;        // 重新连接时使用
+    string              m_User;
+    string              m_PassWord;
+    string              m_DatabaseName;
+    int                 m_Port;
+
+    resume_func         m_resume;
+    void*               m_arg;
+    int                 m_close_log;  //日志开关
+};
+
+#endif
@@ -10,10 +10,78 @@
 
 using namespace std;
 
+static const char *statement_sql[STMT_NUM] =
+{
+	"INSERT INTO user(username, passwd) VALUES(?, ?)",
+};
+
+void prepare_statements(MYSQL *conn, MYSQL_STMT **stmts, int close_log)
+{
+	int m_close_log = close_log; // 日志宏使用m_close_log
+	for (int i = 0; i < STMT_NUM; i++)
+	{
+		stmts[i] = mysql_stmt_init(conn);
+		if (stmts[i] && mysql_stmt_prepare(stmts[i], statement_sql[i], strlen(statement_sql[i])))
+		{
+			LOG_ERROR("MySQL Error: prepare \"%s\" failed: %s", statement_sql[i], mysql_stmt_error(stmts[i]));
+			mysql_stmt_close(stmts[i]);
+			stmts[i] = NULL;
+		}
+	}
+}
+
+void set_timeouts(MYSQL *conn)
+{
+	unsigned int connect_timeout = SQL_CONNECT_TIMEOUT_S;
+	unsigned int io_timeout = SQL_IO_TIMEOUT_S;
+	mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+	mysql_options(conn, MYSQL_OPT_READ_TIMEOUT, &io_timeout);
+	mysql_options(conn, MYSQL_OPT_WRITE_TIMEOUT, &io_timeout);
+}
+
+bool bind_params(MYSQL_STMT *stmt, MYSQL_BIND *bind, unsigned long *lengths, const char **params, int num)
+{
+	memset(bind, 0, sizeof(MYSQL_BIND) * num);
+	for (int i = 0; i < num; i++)
+	{
+		lengths[i] = strlen(params[i]);
+		bind[i].buffer_type = MYSQL_TYPE_STRING;
+		bind[i].buffer = (void *)params[i];
+		bind[i].buffer_length = lengths[i];
+		bind[i].length = &lengths[i];
+	}
+	return !mysql_stmt_bind_param(stmt, bind);
+}
+
+thread_local sql_connection_pool::pinned_conn sql_connection_pool::t_pinned;
+
 sql_connection_pool::sql_connection_pool()
 {
 	m_CurConn = 0;
 	m_FreeConn = 0;
+	m_MaxConn = 0;
+	m_MinConn = 0;
+	m_affine = false;
+	m_pinned = 0;
+	m_waiting = 0;
+	m_wait_since_us = 0;
+	m_last_grow_us = 0;
+	m_started = false;
+	m_stop = false;
+}
+
+sql_connection_pool::pinned_conn::~pinned_conn()
+{
+	//先清空，归还时按普通连接处理
+	MYSQL *con = conn;
+	conn = NULL;
+	if (con)
+		sql_connection_pool::GetInstance()->Unpin(con);
+}
+
+void sql_connection_pool::SetThreadAffine(bool affine)
+{
+	m_affine = affine;
 }
 
 sql_connection_pool *sql_connection_pool::GetInstance()
@@ -23,7 +91,8 @@ sql_connection_pool *sql_connection_pool::GetInstance()
 }
 
 //构造初始化
-void sql_connection_pool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log)
+void sql_connection_pool::init(string url, string User, string PassWord, string DBName, int Port, int MaxConn, int close_log,
+                               int MinConn)
 {
 	m_url = url;
 	m_Port = Port;
@@ -32,38 +101,255 @@ void sql_connection_pool::init(string url, string User, string PassWord, string
 	m_DatabaseName = DBName;
 	m_close_log = close_log;
 
-	for (int i = 0; i < MaxConn; i++)
+	if (MaxConn <= 0)
+		return;
+	m_MinConn = (MinConn > 0 && MinConn < MaxConn) ? MinConn : MaxConn;
+	m_slots.resize(MaxConn);
+
+	//建立连接的大部分时间在等待数据库的往返，各连接在单独的线程上同时建立；
+	//客户端库须在创建线程前初始化
+	mysql_library_init(0, NULL, NULL);
+	vector<pthread_t> threads(m_MinConn);
+	vector<bool> started(m_MinConn, false);
+	for (int i = 0; i < m_MinConn; i++)
+		started[i] = pthread_create(&threads[i], NULL, open_worker, &m_slots[i]) == 0;
+	for (int i = 0; i < m_MinConn; i++)
+	{
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			connect(&m_slots[i]);
+	}
+
+	//未能建立的连接仍放入连接池，由维护线程或取用它的线程重新连接；一个都没有建立时无法启动
+	int opened = 0;
+	for (int i = 0; i < m_MinConn; i++)
+	{
+		if (!m_slots[i].broken)
+			++opened;
+		connList.push_back(&m_slots[i].mysql);
+		++m_FreeConn;
+	}
+	if (0 == opened)
+	{
+		LOG_ERROR("MySQL Error: none of %d connections established", m_MinConn);
+		exit(1);
+	}
+	for (int i = m_MinConn; i < MaxConn; i++)
+		m_closed.push_back(&m_slots[i]);
+
+	reserve = sem(m_FreeConn);
+	m_MaxConn = MaxConn;
+	stats::get_instance()->add(stats::SQL_FREE, m_FreeConn);
+
+	if (pthread_create(&m_thread, NULL, maintain_worker, this) != 0)
+	{
+		LOG_ERROR("%s", "sql_connection_pool: create maintain thread failed");
+		exit(1);
+	}
+	m_started = true;
+}
+
+void *sql_connection_pool::open_worker(void *arg)
+{
+	mysql_thread_init();
+	sql_connection_pool::GetInstance()->connect((conn_slot *)arg);
+	mysql_thread_end();
+	return NULL;
+}
+
+sql_connection_pool::conn_slot *sql_connection_pool::slot_of(MYSQL *conn)
+{
+	if (m_slots.empty() || conn < &m_slots.front().mysql || conn > &m_slots.back().mysql)
+		return NULL;
+	return (conn_slot *)conn;
+}
+
+bool sql_connection_pool::connect(conn_slot *s)
+{
+	MYSQL *con = &s->mysql;
+	for (int i = 0; i < STMT_NUM; i++)
+		s->stmts[i] = NULL;
+	s->last_used_us = s->last_check_us = stats::now_us();
+	s->broken = true;
+
+	if (mysql_init(con) == NULL)
+	{
+		LOG_ERROR("MySQL Error: mysql_init() returns NULL");
+		return false;
+	}
+	set_timeouts(con);
+	if (mysql_real_connect(con, m_url.c_str(), m_User.c_str(), m_PassWord.c_str(), m_DatabaseName.c_str(), m_Port, NULL, 0) == NULL)
+	{
+		string err_info( mysql_error(con) );
+		err_info = (string("MySQL Error[errno=")
+			+ std::to_string(mysql_errno(con)) + string("]: ") + err_info);
+		LOG_ERROR( err_info.c_str() );
+		return false;
+	}
+
+	//每个连接各自准备一次语句，之后随连接复用
+	prepare_statements(con, s->stmts, m_close_log);
+	s->broken = false;
+	return true;
+}
+
+void sql_connection_pool::disconnect(conn_slot *s)
+{
+	//语句随连接关闭
+	for (int i = 0; i < STMT_NUM; i++)
+	{
+		if (s->stmts[i])
+			mysql_stmt_close(s->stmts[i]);
+		s->stmts[i] = NULL;
+	}
+	mysql_close(&s->mysql);
+}
+
+bool sql_connection_pool::Reconnect(MYSQL *conn)
+{
+	conn_slot *s = slot_of(conn);
+	if (!s)
+		return false;
+	disconnect(s);
+	if (!connect(s))
+		return false;
+	stats::get_instance()->add(stats::SQL_RECONNECT);
+	LOG_INFO("MySQL reconnected");
+	return true;
+}
+
+void *sql_connection_pool::maintain_worker(void *arg)
+{
+	sql_connection_pool *pool = (sql_connection_pool *)arg;
+	mysql_thread_init();
+	pool->maintain();
+	mysql_thread_end();
+	return NULL;
+}
+
+void sql_connection_pool::maintain()
+{
+	long long next_check = stats::now_us() + MAINTAIN_MS * 1000LL;
+	lock.lock();
+	while (!m_stop)
 	{
-		MYSQL* con = NULL;
-		MYSQL* ret = nullptr;
+		long long now = stats::now_us();
+		long long wake = next_check;
 
-		ret = mysql_init(con);
-		if (ret == NULL)
+		//有线程等待连接超过GROW_WAIT_US时新建一个，建立连接期间不持有锁
+		if (m_waiting > 0 && !m_closed.empty())
 		{
-			LOG_ERROR("MySQL Error: mysql_init() returns NULL");
-			exit(1);
-		} else {
-			con = ret;
+			long long since = m_wait_since_us > m_last_grow_us ? m_wait_since_us : m_last_grow_us;
+			if (now >= since + GROW_WAIT_US)
+			{
+				conn_slot *s = m_closed.front();
+				m_closed.pop_front();
+				lock.unlock();
+
+				bool ok = connect(s);
+				if (!ok)
+					mysql_close(&s->mysql);
+
+				lock.lock();
+				if (ok)
+				{
+					m_last_grow_us = stats::now_us();
+					connList.push_front(&s->mysql);
+					++m_FreeConn;
+					stats::get_instance()->add(stats::SQL_GROW);
+					stats::get_instance()->add(stats::SQL_FREE);
+					reserve.post();
+				}
+				else
+				{
+					//数据库不可达时不反复尝试，等到下一个维护周期
+					m_last_grow_us = stats::now_us() + MAINTAIN_MS * 1000LL;
+					m_closed.push_front(s);
+				}
+				continue;
+			}
+			if (since + GROW_WAIT_US < wake)
+				wake = since + GROW_WAIT_US;
 		}
 
-		ret = mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, NULL, 0);
-		if (ret == NULL)
+		if (now >= next_check)
 		{
-			string err_info( mysql_error(con) );
-			err_info = (string("MySQL Error[errno=")
-				+ std::to_string(mysql_errno(con)) + string("]: ") + err_info);
-			LOG_ERROR( err_info.c_str() );
-			exit(1);
-		} else {
-			con = ret;
+			lock.unlock();
+			check_idle();
+			lock.lock();
+			next_check = stats::now_us() + MAINTAIN_MS * 1000LL;
+			continue;
 		}
 
-		connList.push_back(con);
-		++m_FreeConn;
+		//条件变量按CLOCK_REALTIME计时
+		struct timespec t;
+		clock_gettime(CLOCK_REALTIME, &t);
+		long long ns = t.tv_nsec + (wake - now) * 1000;
+		t.tv_sec += ns / 1000000000;
+		t.tv_nsec = ns % 1000000000;
+		m_maintain.timewait(lock.get(), t);
 	}
+	lock.unlock();
+}
 
-	reserve = sem(m_FreeConn);
-	m_MaxConn = m_FreeConn;
+void sql_connection_pool::check_idle()
+{
+	vector<conn_slot *> checks, closes;
+	long long now = stats::now_us();
+
+	//取出需要处理的空闲连接，每取出一个先占用信号量的一个计数，与取用连接的线程互不冲突
+	lock.lock();
+	int open = m_MaxConn - (int)m_closed.size();
+	list<MYSQL *>::iterator it = connList.begin();
+	while (it != connList.end())
+	{
+		conn_slot *s = slot_of(*it);
+		bool close = open > m_MinConn && now - s->last_used_us >= IDLE_CLOSE_MS * 1000LL;
+		bool check = s->broken || now - s->last_check_us >= KEEPALIVE_MS * 1000LL;
+		if ((!close && !check) || !reserve.trywait())
+		{
+			++it;
+			continue;
+		}
+		it = connList.erase(it);
+		if (close)
+		{
+			--open;
+			--m_FreeConn;
+			closes.push_back(s);
+		}
+		else
+			checks.push_back(s);
+	}
+	lock.unlock();
+
+	for (size_t i = 0; i < closes.size(); ++i)
+	{
+		disconnect(closes[i]);
+		stats::get_instance()->add(stats::SQL_SHRINK);
+		stats::get_instance()->add(stats::SQL_FREE, -1);
+	}
+
+	//断开的或ping失败的重新连接，仍然失败的保持断开状态放回，下个周期再试
+	for (size_t i = 0; i < checks.size(); ++i)
+	{
+		conn_slot *s = checks[i];
+		if (s->broken || mysql_ping(&s->mysql))
+			Reconnect(&s->mysql);
+		s->last_check_us = stats::now_us();
+	}
+
+	lock.lock();
+	for (size_t i = 0; i < closes.size(); ++i)
+		m_closed.push_back(closes[i]);
+	//检查过的仍按空闲最久放在表尾
+	for (size_t i = 0; i < checks.size(); ++i)
+		connList.push_back(&checks[i]->mysql);
+	lock.unlock();
+
+	for (size_t i = 0; i < checks.size(); ++i)
+		reserve.post();
 }
 
 
@@ -72,10 +358,39 @@ MYSQL *sql_connection_pool::GetConnection()
 {
 	MYSQL *con = NULL;
 
-	if (0 == connList.size())
+	//本线程独占的连接空闲时直接取用，不需要任何同步
+	if (t_pinned.conn && !t_pinned.busy)
+	{
+		t_pinned.busy = true;
+		stats::get_instance()->add(stats::SQL_PINNED);
+		return t_pinned.conn;
+	}
+
+	//m_MaxConn在init之后不再改变，可以不加锁读取；connList随取用、归还变化，不能在锁外判断
+	if (0 == m_MaxConn)
 		return NULL;
 
-	reserve.wait();
+	// 等待空闲连接的时间计入统计
+	long long start = stats::now_us();
+	if (!reserve.trywait())
+	{
+		//共享池已空，登记等待，等待过久时由维护线程新建连接
+		lock.lock();
+		if (0 == m_waiting++)
+			m_wait_since_us = start;
+		lock.unlock();
+		m_maintain.signal();
+
+		reserve.wait();
+
+		lock.lock();
+		--m_waiting;
+		lock.unlock();
+	}
+	long long wait_us = stats::now_us() - start;
+	stats::get_instance()->add(stats::SQL_ACQUIRE);
+	stats::get_instance()->add(stats::SQL_WAIT_US, wait_us);
+	stats::get_instance()->observe(stats::SQL_ACQUIRE_US, wait_us);
 
 	lock.lock();
 
@@ -84,22 +399,57 @@ MYSQL *sql_connection_pool::GetConnection()
 
 	--m_FreeConn;
 	++m_CurConn;
+	stats::get_instance()->add(stats::SQL_IN_USE);
+	stats::get_instance()->add(stats::SQL_FREE, -1);
+
+	//尚未独占连接的线程留下这个连接，至少保留一个连接在共享池中，
+	//否则独占了全部连接的线程空闲时，其他线程会一直等待
+	if (m_affine && !t_pinned.conn && m_pinned < m_MaxConn - 1)
+	{
+		++m_pinned;
+		t_pinned.conn = con;
+		t_pinned.busy = true;
+	}
 
 	lock.unlock();
 	return con;
 }
 
+void sql_connection_pool::Unpin(MYSQL *con)
+{
+	lock.lock();
+	--m_pinned;
+	lock.unlock();
+	ReleaseConnection(con);
+}
+
 //释放当前使用的连接
 bool sql_connection_pool::ReleaseConnection(MYSQL *con)
 {
 	if (NULL == con)
 		return false;
 
+	//独占的连接只标记为空闲，不归还共享池
+	if (con == t_pinned.conn && t_pinned.busy)
+	{
+		t_pinned.busy = false;
+		return true;
+	}
+
+	//最近用过的放在表头优先取用，少用的连接留在表尾，空闲过久时收缩；
+	//归还时刻由维护线程在锁内读取，同样在锁内写入
+	conn_slot *s = slot_of(con);
+	long long now = stats::now_us();
+
 	lock.lock();
 
-	connList.push_back(con);
+	if (s)
+		s->last_used_us = s->last_check_us = now;
+	connList.push_front(con);
 	++m_FreeConn;
 	--m_CurConn;
+	stats::get_instance()->add(stats::SQL_IN_USE, -1);
+	stats::get_instance()->add(stats::SQL_FREE);
 
 	lock.unlock();
 
@@ -107,19 +457,61 @@ bool sql_connection_pool::ReleaseConnection(MYSQL *con)
 	return true;
 }
 
+MYSQL_STMT *sql_connection_pool::GetStatement(MYSQL *conn, SQL_STATEMENT id)
+{
+	conn_slot *s = slot_of(conn);
+	return s ? s->stmts[id] : NULL;
+}
+
+int sql_connection_pool::Execute(MYSQL *conn, SQL_STATEMENT id, const char **params, int num)
+{
+	conn_slot *s = slot_of(conn);
+	if (!s || num > SQL_MAX_PARAMS)
+		return 1;
+	//上次未能重新连接的，取用时再试一次
+	if (s->broken && !Reconnect(conn))
+		return 1;
+
+	MYSQL_BIND bind[SQL_MAX_PARAMS];
+	unsigned long lengths[SQL_MAX_PARAMS];
+	for (int attempt = 0; ; ++attempt)
+	{
+		MYSQL_STMT *stmt = s->stmts[id];
+		if (!stmt || !bind_params(stmt, bind, lengths, params, num))
+			return 1;
+		if (0 == mysql_stmt_execute(stmt))
+			return 0;
+
+		unsigned int err = mysql_stmt_errno(stmt);
+		LOG_ERROR("MySQL Error: execute failed: %s", mysql_stmt_error(stmt));
+		if (!connection_lost(err))
+			return 1;
+		//CR_SERVER_LOST时语句可能已在数据库上执行，不重试，只为之后的请求重新连接
+		if (!Reconnect(conn) || attempt > 0 || CR_SERVER_GONE_ERROR != err)
+			return 1;
+	}
+}
+
 //销毁数据库连接池
 void sql_connection_pool::DestroyPool()
 {
+	//先停止维护线程，它可能正持有取出的连接
+	if (m_started)
+	{
+		lock.lock();
+		m_stop = true;
+		lock.unlock();
+		m_maintain.signal();
+		pthread_join(m_thread, NULL);
+		m_started = false;
+	}
 
 	lock.lock();
 	if (connList.size() > 0)
 	{
 		list<MYSQL *>::iterator it;
 		for (it = connList.begin(); it != connList.end(); ++it)
-		{
-			MYSQL *con = *it;
-			mysql_close(con);
-		}
+			disconnect(slot_of(*it));
 		m_CurConn = 0;
 		m_FreeConn = 0;
 		connList.clear();
@@ -3,16 +3,43 @@
 
 #include <stdio.h>
 #include <list>
+#include <vector>
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
 #include <error.h>
 #include <string.h>
 #include <iostream>
 #include <string>
 #include "../lock/locker.h"
 #include "../log/log.h"
+#include "../stats/stats.h"
 
 using namespace std;
 
+// 预编译语句：每个连接建立后各准备一次，处理请求时只绑定参数执行，
+// 不再拼接SQL(用户输入不会被当作SQL解析)，服务器也不必每次重新解析语句
+enum SQL_STATEMENT
+{
+	STMT_REGISTER = 0,	//注册：INSERT INTO user(username, passwd) VALUES(?, ?)
+	STMT_NUM
+};
+
+static const int SQL_MAX_PARAMS = 2;	//语句的最大参数个数
+static const int SQL_CONNECT_TIMEOUT_S = 3;	//建立连接的超时时间，数据库不可达时重新连接不会长时间阻塞
+static const int SQL_IO_TIMEOUT_S = 10;		//连接上读写的超时时间，数据库无响应时mysql_ping和查询不会一直阻塞
+
+// 在mysql_real_connect之前设置连接、读写的超时时间
+void set_timeouts(MYSQL *conn);
+// 在conn上准备全部语句存入stmts，失败的为NULL
+void prepare_statements(MYSQL *conn, MYSQL_STMT **stmts, int close_log);
+// 把num个字符串参数绑定到stmt，bind和lengths须保持到执行结束
+bool bind_params(MYSQL_STMT *stmt, MYSQL_BIND *bind, unsigned long *lengths, const char **params, int num);
+// 错误码表示连接已断开(数据库重启、空闲超时被断开等)，需要重新连接
+inline bool connection_lost(unsigned int err)
+{
+	return CR_SERVER_GONE_ERROR == err || CR_SERVER_LOST == err;
+}
+
 class sql_connection_pool
 {
 public:
@@ -21,25 +48,90 @@ public:
 	int GetFreeConn();					 //获取连接
 	void DestroyPool();					 //销毁所有连接
 
+	//取出conn上预先准备好的语句，准备失败时为NULL
+	MYSQL_STMT *GetStatement(MYSQL *conn, SQL_STATEMENT id);
+	//绑定字符串参数执行conn上的预编译语句，成功返回0。
+	//连接已断开时先重新连接，语句未发出(CR_SERVER_GONE_ERROR)的重试一次
+	int Execute(MYSQL *conn, SQL_STATEMENT id, const char **params, int num);
+	//在原MYSQL对象上重新建立连接并重新准备语句，调用者须持有该连接
+	bool Reconnect(MYSQL *conn);
+
 	//单例模式
 	static sql_connection_pool *GetInstance();
 
-	void init(string url, string User, string PassWord, string DataBaseName, int Port, int MaxConn, int close_log);
+	//并行建立MinConn个连接(0表示与MaxConn相同)，等待连接过久时由维护线程逐个新建，至多MaxConn个；
+	//维护线程还定期检查空闲的连接，断开的重新连接，超出MinConn且长时间空闲的关闭
+	void init(string url, string User, string PassWord, string DataBaseName, int Port, int MaxConn, int close_log,
+	          int MinConn = 0);
+	//线程独占模式：线程第一次从共享池取得的连接留给该线程独占，之后取用、归还都不需要同步，
+	//线程退出时归还共享池；至多MaxConn-1个连接被独占，其余的作为共享的后备池。
+	//在启动阶段的查询之后开启，主线程不独占连接
+	void SetThreadAffine(bool affine);
 
 private:
 	sql_connection_pool();
 	~sql_connection_pool();
 
+	// 共享池为空、有线程等待超过该时间时新建一个连接，两次新建之间也至少间隔该时间
+	static const int GROW_WAIT_US     = 2000;
+	// 维护线程检查空闲连接的周期
+	static const int MAINTAIN_MS      = 1000;
+	// 空闲超过该时间的连接用mysql_ping检查，避免被数据库的wait_timeout断开后才被取用
+	static const int KEEPALIVE_MS     = 30000;
+	// 超出最少连接数的连接空闲超过该时间后关闭
+	static const int IDLE_CLOSE_MS    = 60000;
+
+	//一个连接及其上预编译的语句。m_slots在init时按最大连接数分配，之后不再扩容，
+	//MYSQL对象在其中的地址不变，重新连接也在原对象上进行，取出连接的线程和独占的线程不受影响
+	struct conn_slot
+	{
+		MYSQL       mysql;              //须为第一个成员，由MYSQL*直接得到所在的conn_slot
+		MYSQL_STMT* stmts[STMT_NUM];    //准备失败或连接断开时为NULL
+		bool        broken;             //连接未能建立，取用或维护时重新连接
+		long long   last_used_us;       //最近一次归还的时刻
+		long long   last_check_us;      //最近一次归还或检查的时刻
+	};
+	conn_slot *slot_of(MYSQL *conn);
+	bool connect(conn_slot *s);        //在已分配的slot上建立连接、准备语句
+	void disconnect(conn_slot *s);
+	static void *open_worker(void *arg);
+	static void *maintain_worker(void *arg);
+	void maintain();                   //维护线程：按等待时间新建连接，定期检查空闲连接
+	void check_idle();
+
+	//线程独占的连接，线程退出时由析构函数归还共享池
+	struct pinned_conn
+	{
+		MYSQL *conn;
+		bool   busy;	//已被本线程取用，再次取用时从共享池取
+		pinned_conn() : conn(NULL), busy(false) {}
+		~pinned_conn();
+	};
+	static thread_local pinned_conn t_pinned;
+	void Unpin(MYSQL *conn);
+
     int          m_MaxConn;  //最大连接数
+    int          m_MinConn;  //最少保持的连接数
     int          m_CurConn;  //当前已使用的连接数
     int          m_FreeConn; //当前空闲的连接数
     locker       lock;
-    list<MYSQL*> connList;   //连接池
-    sem          reserve;
+    list<MYSQL*> connList;   //连接池，最近归还的在表头，表尾的空闲最久
+    sem          reserve;  //共享池中的空闲连接数
+    bool         m_affine; //线程独占模式
+    int          m_pinned; //被线程独占的连接数，由lock保护
+    vector<conn_slot> m_slots;    //全部连接，init之后不再扩容
+    list<conn_slot*>  m_closed;   //尚未建立或已关闭的连接，由lock保护
+    int          m_waiting;       //在共享池上等待的线程数，由lock保护
+    long long    m_wait_since_us; //m_waiting由0变为正的时刻
+    long long    m_last_grow_us;  //上次新建连接的时刻，新建失败时推迟到下次重试的时刻
+    cond         m_maintain;      //唤醒维护线程
+    pthread_t    m_thread;
+    bool         m_started;
+    bool         m_stop;          //由lock保护
 
 public:
     string m_url;          //主机地址
-    string m_Port;         //数据库端口号
+    int    m_Port;         //数据库端口号
     string m_User;         //登陆数据库用户名
     string m_PassWord;     //登陆数据库密码
     string m_DatabaseName; //使用数据库名
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "buffer_pool.h"
+#include "../stats/stats.h"
+
+buffer_pool::buffer_pool()
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+    {
+        m_free[i].head = NULL;
+        m_free[i].count = 0;
+    }
+}
+
+buffer_pool::~buffer_pool()
+{
+    for (int i = 0; i < CLASS_NUM; ++i)
+    {
+        char *buf = m_free[i].head;
+        while (buf)
+        {
+            char *next = *(char **)buf;
+            free(buf);
+            buf = next;
+        }
+    }
+}
+
+//size所在的规格：不小于size的最小的2的幂
+int buffer_pool::class_of(int size)
+{
+    int c = 0;
+    while ((MIN_SIZE << c) < size)
+        ++c;
+    return c;
+}
+
+char *buffer_pool::get(int size, int &capacity)
+{
+    if (size > MAX_SIZE)
+        return NULL;
+    int c = class_of(size);
+    capacity = MIN_SIZE << c;
+    stats::get_instance()->add(stats::BUFFER_BYTES, capacity);
+
+    free_list &fl = m_free[c];
+    fl.lock.lock();
+    char *buf = fl.head;
+    if (buf)
+    {
+        fl.head = *(char **)buf;
+        --fl.count;
+    }
+    fl.lock.unlock();
+
+    if (!buf)
+    {
+        stats::get_instance()->add(stats::BUFFER_ALLOC);
+        buf = (char *)malloc(capacity);
+        if (!buf)
+            stats::get_instance()->add(stats::BUFFER_BYTES, -capacity);
+    }
+    return buf;
+}
+
+void buffer_pool::put(char *buf, int capacity)
+{
+    if (!buf)
+        return;
+    stats::get_instance()->add(stats::BUFFER_BYTES, -capacity);
+
+    int c = class_of(capacity);
+    free_list &fl = m_free[c];
+    fl.lock.lock();
+    if ((long long)(fl.count + 1) * capacity <= MAX_FREE_BYTES)
+    {
+        *(char **)buf = fl.head;
+        fl.head = buf;
+        ++fl.count;
+        buf = NULL;
+    }
+    fl.lock.unlock();
+
+    free(buf);
+}
@@ -0,0 +1,45 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "../lock/locker.h"
+
+// 按规格分级的缓冲区池：规格为1KB到64KB之间的2的幂，所有连接、所有线程共享。
+// 连接只在有数据要处理时才持有读写缓冲区，空闲的长连接不占用缓冲区；
+// 归还的缓冲区挂在对应规格的空闲链表上供下次复用，每种规格缓存的总字节数有上限，超出部分直接释放。
+class buffer_pool
+{
+public:
+    static const int MIN_SIZE = 1024;
+    static const int MAX_SIZE = 64 * 1024;
+
+    static buffer_pool *get_instance()
+    {
+        static buffer_pool instance;
+        return &instance;
+    }
+
+    // 取得容量不小于size的缓冲区，实际容量(所在规格的大小)写入capacity；size超过最大规格或内存不足时返回NULL
+    char *get(int size, int &capacity);
+    // 归还get取得的缓冲区，capacity为取得时的实际容量
+    void put(char *buf, int capacity);
+
+private:
+    buffer_pool();
+    ~buffer_pool();
+
+    static const int CLASS_NUM = 7;                     // 1KB, 2KB, ... 64KB
+    static const long long MAX_FREE_BYTES = 16 << 20;   // 每种规格空闲链表中最多缓存的字节数
+
+    static int class_of(int size);
+
+    // 空闲的缓冲区以其开头的8个字节链接
+    struct free_list
+    {
+        locker lock;
+        char*  head;
+        int    count;
+    };
+    free_list m_free[CLASS_NUM];
+};
+
+#endif
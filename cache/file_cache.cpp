@@ -0,0 +1,215 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "file_cache.h"
+#include "../stats/stats.h"
+
+file_cache::file_cache()
+{
+    m_max_files = 0;
+    m_max_bytes = 0;
+    m_bytes = 0;
+    m_response_size = 0;
+    m_header = NULL;
+}
+
+file_cache::~file_cache()
+{
+    for (list<file_entry*>::iterator it = m_lru.begin(); it != m_lru.end(); ++it)
+        free_file(*it);
+}
+
+void file_cache::init(int max_files, long long max_bytes, int response_size, header_func header)
+{
+    m_max_files = max_files;
+    m_max_bytes = max_bytes;
+    m_response_size = response_size;
+    m_header = header;
+}
+
+// 打开并映射文件，不满足缓存条件时返回NULL
+file_entry *file_cache::open_file(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH) || st.st_size > m_max_bytes)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    char *address = NULL;
+    if (st.st_size > 0)
+    {
+        address = (char *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    file_entry *file = new file_entry;
+    file->path = path;
+    file->fd = fd;
+    file->st = st;
+    file->address = address;
+    file->ref = 0;
+    file->evicted = false;
+    file->checked_ms = stats::now_us() / 1000;
+
+    // 小文件的响应头每次都相同，连同文件内容预先生成长、短连接两种完整响应，命中时一次发送
+    for (int linger = 0; linger < 2; ++linger)
+    {
+        file->response[linger] = NULL;
+        file->response_len[linger] = 0;
+        if (!response_cacheable(st.st_size))
+            continue;
+
+        char header[256];
+        int len = m_header(header, sizeof(header), st.st_size, linger);
+        file->response[linger] = new char[len + st.st_size];
+        memcpy(file->response[linger], header, len);
+        memcpy(file->response[linger] + len, address, st.st_size);
+        file->response_len[linger] = len + st.st_size;
+    }
+    return file;
+}
+
+long long file_cache::file_bytes(file_entry *file)
+{
+    return file->st.st_size + file->response_len[0] + file->response_len[1];
+}
+
+void file_cache::free_file(file_entry *file)
+{
+    if (file->address)
+        munmap(file->address, file->st.st_size);
+    close(file->fd);
+    delete[] file->response[0];
+    delete[] file->response[1];
+    delete file;
+}
+
+// 磁盘上的文件已被修改、替换或删除
+bool file_cache::changed(file_entry *file)
+{
+    struct stat st;
+    if (stat(file->path.c_str(), &st) < 0)
+        return true;
+    return st.st_ino != file->st.st_ino || st.st_dev != file->st.st_dev || st.st_size != file->st.st_size ||
+           st.st_mtim.tv_sec != file->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != file->st.st_mtim.tv_nsec;
+}
+
+file_entry *file_cache::acquire(const char *path, bool open)
+{
+    if (m_max_files <= 0)
+        return NULL;
+
+    long long now_ms = stats::now_us() / 1000;
+    m_lock.lock();
+    unordered_map<string, file_entry*>::iterator it = m_files.find(path);
+    if (it != m_files.end())
+    {
+        file_entry *file = it->second;
+        ++file->ref;
+        m_lru.splice(m_lru.begin(), m_lru, file->lru_pos);
+        // 距上次确认超过REVALIDATE_MS时由本次命中检查磁盘上的文件，不持锁进行，其他线程照常命中
+        bool check = now_ms - file->checked_ms >= REVALIDATE_MS;
+        if (check)
+            file->checked_ms = now_ms;
+        m_lock.unlock();
+        if (!check || !changed(file))
+        {
+            stats::get_instance()->add(stats::FILE_CACHE_HIT);
+            return file;
+        }
+
+        // 文件已改变：移出缓存，按未命中重新打开；正在发送旧内容的响应不受影响
+        stats::get_instance()->add(stats::FILE_CACHE_STALE);
+        m_lock.lock();
+        if (!file->evicted)
+            remove(file);
+        m_lock.unlock();
+        release(file);
+    }
+    else
+        m_lock.unlock();
+    if (!open)
+        return NULL;
+
+    // 打开和映射文件较慢，不持锁进行；其他线程可能同时打开了同一个文件，插入时再检查一次。
+    // 不能缓存的文件单独计数，未命中只统计可以放入缓存的文件
+    file_entry *file = open_file(path);
+    if (!file)
+    {
+        stats::get_instance()->add(stats::FILE_CACHE_SKIP);
+        return NULL;
+    }
+    stats::get_instance()->add(stats::FILE_CACHE_MISS);
+
+    m_lock.lock();
+    it = m_files.find(path);
+    if (it != m_files.end())
+    {
+        free_file(file);
+        file = it->second;
+        ++file->ref;
+        m_lru.splice(m_lru.begin(), m_lru, file->lru_pos);
+        m_lock.unlock();
+        return file;
+    }
+
+    file->ref = 1;
+    m_lru.push_front(file);
+    file->lru_pos = m_lru.begin();
+    m_files[file->path] = file;
+    m_bytes += file_bytes(file);
+    stats::get_instance()->add(stats::RESPONSE_CACHE_BYTES, file->response_len[0] + file->response_len[1]);
+    evict();
+    m_lock.unlock();
+    return file;
+}
+
+void file_cache::release(file_entry *file)
+{
+    if (!file)
+        return;
+
+    m_lock.lock();
+    bool last = (--file->ref == 0) && file->evicted;
+    m_lock.unlock();
+
+    if (last)
+        free_file(file);
+}
+
+// 移出缓存；仍被引用的文件等最后一个引用释放时再关闭
+// 调用者持有m_lock
+void file_cache::remove(file_entry *file)
+{
+    m_lru.erase(file->lru_pos);
+    m_files.erase(file->path);
+    m_bytes -= file_bytes(file);
+    stats::get_instance()->add(stats::RESPONSE_CACHE_BYTES, -(file->response_len[0] + file->response_len[1]));
+
+    if (file->ref == 0)
+        free_file(file);
+    else
+        file->evicted = true;
+}
+
+// 从最久未使用的文件开始淘汰，直到满足上限
+// 调用者持有m_lock
+void file_cache::evict()
+{
+    while (!m_lru.empty() && ((int)m_files.size() > m_max_files || m_bytes > m_max_bytes))
+    {
+        stats::get_instance()->add(stats::FILE_CACHE_EVICT);
+        remove(m_lru.back());
+    }
+}
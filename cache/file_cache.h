@@ -0,0 +1,81 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "../lock/locker.h"
+
+using namespace std;
+
+// 生成文件响应头的函数，返回写入的长度，由http_conn提供
+typedef int (*header_func)(char *buf, int size, long long content_length, bool linger);
+
+// 缓存的文件：打开的fd、stat结果以及整个文件的只读映射
+struct file_entry
+{
+    string       path;
+    int          fd;
+    struct stat  st;
+    char*        address;  // 空文件为NULL
+    char*        response[2];     // 小文件预先生成的完整响应(响应头+文件内容)，[0]为短连接，[1]为长连接
+    int          response_len[2];
+    int          ref;      // 正在使用该文件的响应数，由缓存的锁保护
+    bool         evicted;  // 已被淘汰出缓存，最后一个引用释放时关闭
+    long long    checked_ms;      // 上次确认磁盘上的文件未改变的时刻，由缓存的锁保护
+    list<file_entry*>::iterator lru_pos;
+};
+
+// 静态资源的文件缓存：以解析后的完整路径为键，所有连接共享。
+// 命中时通常不产生文件系统调用，每个文件每REVALIDATE_MS至多由一次命中stat一次，
+// 磁盘上的文件已被修改或替换时移出缓存、重新打开；响应持有引用期间文件不会被关闭或解除映射；
+// 超出文件数或总字节数上限时按LRU淘汰。
+class file_cache
+{
+public:
+    static file_cache *get_instance()
+    {
+        static file_cache instance;
+        return &instance;
+    }
+
+    // max_files为0表示不使用缓存；不超过response_size字节的文件额外缓存由header生成响应头的完整响应
+    void init(int max_files, long long max_bytes, int response_size = 0, header_func header = NULL);
+
+    // 取得path对应的文件并增加引用。文件不存在、不可读或不是普通文件时返回NULL，
+    // 由调用者按原流程处理；open为false时只查找，未命中时不打开文件，直接返回NULL
+    file_entry *acquire(const char *path, bool open = true);
+    void release(file_entry *file);
+
+    // 该大小的文件放入缓存时是否预先生成完整响应
+    bool response_cacheable(long long size)
+    {
+        return m_max_files > 0 && m_header && size > 0 && size <= m_response_size;
+    }
+
+private:
+    static const int REVALIDATE_MS = 1000;
+
+    file_cache();
+    ~file_cache();
+
+    file_entry *open_file(const char *path);
+    static bool changed(file_entry *file);
+    void remove(file_entry *file);
+    void evict();
+    static void free_file(file_entry *file);
+    static long long file_bytes(file_entry *file);
+
+    int         m_max_files;
+    long long   m_max_bytes;
+    long long   m_bytes;         // 缓存中文件及完整响应的总字节数
+    int         m_response_size;
+    header_func m_header;
+
+    locker                              m_lock;
+    unordered_map<string, file_entry*>  m_files;
+    list<file_entry*>                   m_lru;    // 表头为最近使用
+};
+
+#endif
@@ -30,11 +30,53 @@ Config::Config(){
 
     //并发模型,默认是proactor
     actor_model = 0;
+
+    //从Reactor数量,默认0表示与CPU核数相同(仅多Reactor模式使用)
+    reactor_num = 0;
+
+    //事件后端,默认epoll(1为io_uring,不可用时回退到epoll)
+    event_backend = 0;
+
+    //非活动连接超时时间,默认15000ms
+    idle_timeout = IDLE_TIMEOUT;
+
+    //文件发送方式,默认mmap + writev(1为sendfile)
+    zero_copy = 0;
+
+    //文件缓存的最大文件数,默认256(0为不缓存)
+    file_cache = FILE_CACHE_NUM;
+
+    //最大并发连接数,默认0表示取进程的fd上限
+    max_conn = 0;
+
+    //线程池工作队列,默认0为所有线程共享一个队列(1为每线程一个队列并相互窃取)
+    work_steal = 0;
+
+    //线程池最大线程数,默认0表示与thread_num相同,线程数固定
+    max_thread = 0;
+
+    //同时处理数据库请求的最大线程数,默认0为不分通道
+    db_thread = 0;
+
+    //混合分派,默认0为所有请求交给线程池(1为缓存命中和小文件的静态请求在Reactor线程上直接处理)
+    hybrid = 0;
+
+    //连接事件注册方式,默认0为EPOLLONESHOT逐次重新注册(1为accept时以ET模式一次注册,由连接的所有权状态协调各线程)
+    persist = 0;
+
+    //数据库查询方式,默认0为工作线程阻塞等待(1为交给查询线程用非阻塞接口执行,工作线程不等待)
+    async_sql = 0;
+
+    //数据库连接取用方式,默认0为每次从共享池取用(1为工作线程独占一个连接,超出时再从共享池取用)
+    affine_sql = 0;
+
+    //数据库连接池最少保持的连接数,默认0表示与sql_num相同,连接数固定(小于sql_num时按等待时间在两者之间伸缩)
+    sql_min = 0;
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:r:u:i:z:f:n:w:x:d:y:e:q:b:k:";
     while ((opt = getopt(argc, argv, str)) != -1)
     {
         switch (opt)
@@ -79,6 +121,76 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'r':
+        {
+            reactor_num = atoi(optarg);
+            break;
+        }
+        case 'u':
+        {
+            event_backend = atoi(optarg);
+            break;
+        }
+        case 'i':
+        {
+            idle_timeout = atoi(optarg);
+            break;
+        }
+        case 'z':
+        {
+            zero_copy = atoi(optarg);
+            break;
+        }
+        case 'f':
+        {
+            file_cache = atoi(optarg);
+            break;
+        }
+        case 'n':
+        {
+            max_conn = atoi(optarg);
+            break;
+        }
+        case 'w':
+        {
+            work_steal = atoi(optarg);
+            break;
+        }
+        case 'x':
+        {
+            max_thread = atoi(optarg);
+            break;
+        }
+        case 'd':
+        {
+            db_thread = atoi(optarg);
+            break;
+        }
+        case 'y':
+        {
+            hybrid = atoi(optarg);
+            break;
+        }
+        case 'e':
+        {
+            persist = atoi(optarg);
+            break;
+        }
+        case 'q':
+        {
+            async_sql = atoi(optarg);
+            break;
+        }
+        case 'b':
+        {
+            affine_sql = atoi(optarg);
+            break;
+        }
+        case 'k':
+        {
+            sql_min = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
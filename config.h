@@ -23,6 +23,20 @@ public:
     int thread_num;     // 线程池内的线程数量
     int close_log;      // 是否关闭日志
     int actor_model;    // 并发模型选择
+    int reactor_num;    // 多Reactor模式下的从Reactor数量
+    int event_backend;  // 事件后端选择
+    int idle_timeout;   // 非活动连接超时时间(ms)
+    int zero_copy;      // 文件发送方式
+    int file_cache;     // 文件缓存的最大文件数
+    int max_conn;       // 最大并发连接数
+    int work_steal;     // 线程池是否使用工作窃取
+    int max_thread;     // 线程池最大线程数
+    int db_thread;      // 同时处理数据库请求的最大线程数
+    int hybrid;         // 是否在Reactor线程上直接处理静态请求
+    int persist;        // 连接事件是否只在accept时注册一次
+    int async_sql;      // 数据库查询是否由查询线程非阻塞执行
+    int affine_sql;     // 数据库连接是否由工作线程独占
+    int sql_min;        // 数据库连接池最少保持的连接数
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <assert.h>
+#include "conn_table.h"
+#include "../stats/stats.h"
+#include "../cache/file_cache.h"
+#include "../buffer/buffer_pool.h"
+
+conn_table::conn_table() : m_max_fd(0), m_pages(NULL), m_free(NULL)
+{
+    // 连接对象析构时要归还文件缓存项和读写缓冲区，先构造这两个单例，使其在连接表之后析构
+    file_cache::get_instance();
+    buffer_pool::get_instance();
+}
+
+conn_table::~conn_table()
+{
+    int pages = (m_max_fd + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    for (int i = 0; i < pages; ++i)
+        delete m_pages[i].load();
+    delete[] m_pages;
+    for (size_t i = 0; i < m_slabs.size(); ++i)
+        delete[] m_slabs[i];
+}
+
+void conn_table::init(int max_fd)
+{
+    m_max_fd = max_fd;
+    int pages = (m_max_fd + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    m_pages = new std::atomic<page *>[pages]();
+}
+
+conn_slot *conn_table::alloc(int fd)
+{
+    if (fd < 0 || fd >= m_max_fd)
+        return NULL;
+
+    // 连接总是在close(fd)之前从表中摘下，新接受的fd上不会残留旧连接
+    assert(!get(fd));
+
+    m_lock.lock();
+    page *p = m_pages[fd >> PAGE_SHIFT].load(std::memory_order_relaxed);
+    if (!p)
+    {
+        p = new page();
+        m_pages[fd >> PAGE_SHIFT].store(p, std::memory_order_release);
+    }
+
+    if (!m_deferred.empty())
+        reclaim();
+    if (!m_free)
+    {
+        // slab用尽，一次申请SLAB_SIZE个对象串入空闲链表
+        conn_slot *slab = new conn_slot[SLAB_SIZE];
+        m_slabs.push_back(slab);
+        for (int i = 0; i < SLAB_SIZE; ++i)
+        {
+            slab[i].next_free = m_free;
+            m_free = &slab[i];
+        }
+        stats::get_instance()->add(stats::CONN_ALLOC, SLAB_SIZE);
+    }
+    conn_slot *slot = m_free;
+    m_free = slot->next_free;
+    slot->next_free = NULL;
+    m_lock.unlock();
+
+    p->slot[fd & PAGE_MASK].store(slot, std::memory_order_release);
+    return slot;
+}
+
+void conn_table::remove(int fd)
+{
+    conn_slot *slot = get(fd);
+    if (!slot)
+        return;
+    m_pages[fd >> PAGE_SHIFT].load(std::memory_order_relaxed)->slot[fd & PAGE_MASK].store(NULL, std::memory_order_release);
+    // 先使代数失效再检查使用者：此后登记的线程会看到代数已变(见http_conn::enter)
+    slot->http.invalidate();
+
+    m_lock.lock();
+    if (slot->http.in_use())
+    {
+        m_deferred.push_back(slot);
+        stats::get_instance()->add(stats::CONN_DEFER);
+    }
+    else
+    {
+        slot->next_free = m_free;
+        m_free = slot;
+    }
+    m_lock.unlock();
+}
+
+// 把隔离区中使用者都已离开的对象归还空闲链表，调用者持有m_lock
+void conn_table::reclaim()
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < m_deferred.size(); ++i)
+    {
+        conn_slot *slot = m_deferred[i];
+        if (slot->http.in_use())
+        {
+            m_deferred[kept++] = slot;
+            continue;
+        }
+        slot->next_free = m_free;
+        m_free = slot;
+    }
+    m_deferred.resize(kept);
+}
+
+size_t conn_table::deferred()
+{
+    m_lock.lock();
+    size_t n = m_deferred.size();
+    m_lock.unlock();
+    return n;
+}
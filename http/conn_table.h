@@ -0,0 +1,91 @@
+#ifndef CONN_TABLE_H
+#define CONN_TABLE_H
+
+#include <atomic>
+#include <vector>
+#include "../lock/locker.h"
+#include "../timer/lst_timer.h"
+#include "http_conn.h"
+
+// io_uring后端：recv交付的数据未能全部放入连接的读缓冲区（其中还有未处理的流水线请求）时，
+// 连接暂时持有该provided buffer，处理完已读入的请求后再交付剩余的数据
+struct uring_held
+{
+    int bid;    // 持有的缓冲区，没有为-1
+    int offset; // 剩余数据在缓冲区中的起始位置
+    int len;    // 剩余数据的长度
+};
+
+// 一个连接的全部状态，从slab中整体分配
+struct conn_slot
+{
+    conn_slot() : client(), next_free(NULL) { held.bid = -1; }
+
+    http_conn   http;
+    client_data client;     // 定时器及其回调所需的数据
+    uring_held  held;
+    conn_slot*  next_free;  // 在slab空闲链表中时指向下一个空闲项
+};
+
+// 连接表：以fd为下标的稀疏两级表，连接对象在accept时从slab取出，关闭时归还。
+// 只有fd所在的页第一次使用时才分配该页，内存随同时存在的连接数增长，上限由启动时的fd上限决定。
+// slab中的对象只复用、不释放，关闭后仍留在工作队列或完成队列中的迟到引用访问的始终是有效的连接对象，
+// 与原先按fd复用数组元素时相同，由连接代数和定时器是否为空识别其是否已属于新连接。
+// 关闭时仍有工作线程或查询线程在访问的对象(见http_conn::enter)先放入隔离区，使用者都离开后才重新分配，
+// 正在处理的线程不会写到新连接上；其余对象立即归还空闲链表，后进先出，复用时仍在缓存中。
+class conn_table
+{
+public:
+    static conn_table *get_instance()
+    {
+        static conn_table instance;
+        return &instance;
+    }
+
+    // max_fd为可接受的fd上限(不含)，只分配一级目录
+    void init(int max_fd);
+    int max_fd() { return m_max_fd; }
+
+    // fd上的连接，没有时返回NULL
+    conn_slot *get(int fd)
+    {
+        if (fd < 0 || fd >= m_max_fd)
+            return NULL;
+        page *p = m_pages[fd >> PAGE_SHIFT].load(std::memory_order_acquire);
+        return p ? p->slot[fd & PAGE_MASK].load(std::memory_order_acquire) : NULL;
+    }
+
+    // 为新接受的fd取得连接对象；fd超出上限时返回NULL
+    conn_slot *alloc(int fd);
+    // 连接关闭时在close(fd)之前调用，从表中摘下并归还slab，同时使仍在工作队列中的任务失效
+    void remove(int fd);
+
+    // 隔离区中的对象数
+    size_t deferred();
+
+private:
+    conn_table();
+    ~conn_table();
+
+    static const int PAGE_SHIFT = 12;
+    static const int PAGE_SIZE  = 1 << PAGE_SHIFT;
+    static const int PAGE_MASK  = PAGE_SIZE - 1;
+    static const int SLAB_SIZE  = 64;   // slab每次向系统申请的连接对象数
+
+    struct page
+    {
+        std::atomic<conn_slot *> slot[PAGE_SIZE];
+    };
+
+    int                  m_max_fd;
+    std::atomic<page *>* m_pages;
+
+    void reclaim();
+
+    locker                   m_lock;    // 保护页的分配、slab、空闲链表和隔离区
+    conn_slot*               m_free;
+    std::vector<conn_slot *> m_deferred;  // 隔离区：关闭时仍有使用者的对象
+    std::vector<conn_slot *> m_slabs;
+};
+
+#endif
@@ -17,8 +17,15 @@ const char* error_500_form  = "There was an unusual problem serving the request
 locker m_lock;
 map<string, string> users;
 
-void http_conn::initmysql_result(sql_connection_pool *connPool)
+sql_connection_pool *http_conn::m_connPool = NULL;
+sql_async *http_conn::m_sqlAsync = NULL;
+
+void http_conn::initmysql_result(sql_connection_pool *connPool, int close_log, sql_async *sqlAsync)
 {
+    int m_close_log = close_log; // 日志宏使用m_close_log
+    m_connPool = connPool;
+    m_sqlAsync = sqlAsync;
+
     //先从连接池中取一个连接
     MYSQL *mysql = NULL;
     connectionRAII mysqlcon(&mysql, connPool);
@@ -57,8 +64,12 @@ int setnonblocking(int fd)
 }
 
 //将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
+//epollfd为-1表示连接由io_uring后端驱动，不使用epoll
 void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
 {
+    if (epollfd < 0)
+        return;
+
     epoll_event event;
     event.data.fd = fd;
 
@@ -70,19 +81,27 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode)
     if (one_shot)
         event.events |= EPOLLONESHOT;
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+    stats::get_instance()->add(stats::SYSCALL);
     setnonblocking(fd);
 }
 
-//从内核时间表删除描述符
-void removefd(int epollfd, int fd)
+//连接所有权模式：读写事件以ET模式在accept时一次注册，不使用EPOLLONESHOT，之后不再修改
+static void addfd_persist(int epollfd, int fd)
 {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
-    close(fd);
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+    stats::get_instance()->add(stats::SYSCALL);
+    setnonblocking(fd);
 }
 
 //将事件重置为EPOLLONESHOT
 void modfd(int epollfd, int fd, int ev, int TRIGMode)
 {
+    if (epollfd < 0)
+        return;
+
     epoll_event event;
     event.data.fd = fd;
 
@@ -92,41 +111,58 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
         event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
 
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+    stats::get_instance()->add(stats::SYSCALL);
 }
 
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
+std::atomic<int> http_conn::m_user_count(0);
+std::atomic<unsigned int> http_conn::m_next_generation(0);
 
-//关闭连接，关闭一个连接，客户总量减一
+//关闭连接：连接的定时器在accept它的Reactor的时间轮中，只能由该Reactor删除定时器并关闭fd，
+//否则fd关闭后可能立即被其他Reactor复用，而旧的定时器仍链在原时间轮中。
+//这里只shutdown并重新注册读事件，Reactor收到EPOLLRDHUP后按正常路径关闭；
+//io_uring后端由事件循环之后提交的recv/send失败后关闭
 void http_conn::close_conn(bool real_close)
 {
     if (real_close && (m_sockfd != -1))
     {
-        printf("close %d\n", m_sockfd);
-        removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;
+        shutdown(m_sockfd, SHUT_RDWR);
+        stats::get_instance()->add(stats::SYSCALL);
+        if (m_epollfd >= 0)
+            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
     }
 }
 
 //初始化连接,外部调用初始化套接字地址
-void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
-                     int close_log, string user, string passwd, string sqlname)
+void http_conn::init(int sockfd, const sockaddr_in &addr, int epollfd, char *root, int TRIGMode,
+                     int close_log, int zero_copy, bool persist, completion_queue *closed)
 {
+    // 上一个连接若在发送途中被关闭，释放其遗留的文件映射或文件描述符，以及读写缓冲区
+    unmap();
+    free_buffers();
+
     m_sockfd = sockfd;
     m_address = addr;
+    m_epollfd = epollfd;
+    m_generation.store(++m_next_generation, std::memory_order_relaxed);
+    m_TRIGMode = TRIGMode;
+    m_zero_copy = zero_copy;
+    m_persist = persist && epollfd >= 0;
+    m_owner.store(OWNER_IDLE, std::memory_order_relaxed);
+    m_closed = closed;
 
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    // 所有权模式下事件只在此注册一次，必须用ET模式读
+    if (m_persist)
+    {
+        m_TRIGMode = 1;
+        addfd_persist(m_epollfd, sockfd);
+    }
+    else
+        addfd(m_epollfd, sockfd, true, m_TRIGMode);
     m_user_count++;
 
     //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
-    m_TRIGMode = TRIGMode;
     m_close_log = close_log;
-
-    strcpy(sql_user, user.c_str());
-    strcpy(sql_passwd, passwd.c_str());
-    strcpy(sql_name, sqlname.c_str());
     LOG_INFO("http_conn::init(%x)", this);
 
     __init();
@@ -136,9 +172,26 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
 //check_state默认为分析请求行状态
 void http_conn::__init()
 {
-    mysql            = NULL;
-    bytes_to_send    = 0;
-    bytes_have_send  = 0;
+    m_read_idx       = 0;
+    m_checked_idx    = 0;
+    m_state          = 0;
+    m_deferred       = false;
+    m_want_read      = false;
+    m_sql_state      = SQL_NONE;
+    m_sql_gen        = 0;
+
+    init_request();
+    init_batch();
+    LOG_INFO("http_conn::__init(%x)", this);
+}
+
+//开始解析下一个请求：读缓冲区中m_checked_idx之后的字节属于流水线中的后续请求，予以保留
+void http_conn::init_request()
+{
+    // 恢复上一个请求的请求体末尾'\0'覆盖的字节
+    if (m_check_state == CHECK_STATE_CONTENT && m_checked_idx < m_read_idx)
+        m_read_buf[m_checked_idx] = m_content_next;
+
     m_check_state    = CHECK_STATE_REQUESTLINE;
     m_linger         = false;
     m_method         = GET;
@@ -146,19 +199,113 @@ void http_conn::__init()
     m_version        = 0;
     m_content_length = 0;
     m_host           = 0;
-    m_start_line     = 0;
-    m_checked_idx    = 0;
-    m_read_idx       = 0;
-    m_write_idx      = 0;
+    m_request_start  = m_checked_idx;
+    m_start_line     = m_checked_idx;
+    m_sep_idx        = -1;
+    m_line_sep       = -1;
+    m_write_start    = m_write_idx;
     cgi              = 0;
-    m_state          = 0;
-    timer_flag       = 0;
-    improv           = 0;
 
-    memset(m_read_buf , '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
-    LOG_INFO("http_conn::__init(%x)", this);
+}
+
+//本批响应发送完毕，归还写缓冲区；未处理的请求移到读缓冲区开头，为后续读取腾出空间，
+//读缓冲区中没有剩余数据时一并归还，空闲的长连接不持有缓冲区
+void http_conn::init_batch()
+{
+    bytes_to_send   = 0;
+    bytes_have_send = 0;
+    m_write_idx     = 0;
+    m_write_start   = 0;
+    m_iv_count      = 0;
+    m_iv_idx        = 0;
+    m_resp_count    = 0;
+    m_keep_alive    = false;
+
+    for (int i = 0; i < m_write_chunks; ++i)
+        buffer_pool::get_instance()->put(m_write_chunk[i], WRITE_BUFFER_SIZE);
+    m_write_chunks = 0;
+    m_write_buf    = NULL;
+
+    // 当前请求可能已解析了一部分，指向读缓冲区的下标和指针一并平移
+    int shift = m_request_start;
+    if (shift > 0)
+    {
+        memmove(m_read_buf, m_read_buf + shift, m_read_idx - shift);
+        m_read_idx      -= shift;
+        m_read_buf[m_read_idx] = '\0';
+        m_checked_idx   -= shift;
+        m_start_line    -= shift;
+        m_request_start  = 0;
+        if (m_sep_idx >= 0)
+            m_sep_idx -= shift;
+        if (m_url)
+            m_url -= shift;
+        if (m_version)
+            m_version -= shift;
+        if (m_host)
+            m_host -= shift;
+    }
+
+    if (m_read_idx == 0 && m_read_buf)
+    {
+        buffer_pool::get_instance()->put(m_read_buf, m_read_size + 1);
+        m_read_buf  = NULL;
+        m_read_size = 0;
+    }
+}
+
+void http_conn::free_buffers()
+{
+    // 丢弃读缓冲区中的数据，由init_batch归还读写缓冲区
+    m_read_idx      = 0;
+    m_request_start = 0;
+    init_batch();
+}
+
+//读缓冲区已满：从缓冲区池取加倍规格的缓冲区并搬移已读入的数据，没有缓冲区时取初始规格
+bool http_conn::grow_read_buf()
+{
+    int size = m_read_buf ? 2 * (m_read_size + 1) : READ_BUFFER_SIZE;
+    if (size > READ_BUFFER_MAX)
+        return false;
+    int capacity;
+    char *buf = buffer_pool::get_instance()->get(size, capacity);
+    if (!buf)
+        return false;
+
+    if (m_read_buf)
+    {
+        stats::get_instance()->add(stats::BUFFER_GROW);
+        memcpy(buf, m_read_buf, m_read_idx);
+        // 当前请求可能已解析了一部分，指向读缓冲区的指针一并改指新的缓冲区
+        if (m_url)
+            m_url = buf + (m_url - m_read_buf);
+        if (m_version)
+            m_version = buf + (m_version - m_read_buf);
+        if (m_host)
+            m_host = buf + (m_host - m_read_buf);
+        buffer_pool::get_instance()->put(m_read_buf, m_read_size + 1);
+    }
+    m_read_buf  = buf;
+    m_read_size = capacity - 1;
+    m_read_buf[m_read_idx] = '\0';
+    return true;
+}
+
+//取一块新的写缓冲区；之前的块中还有本批尚未发出的响应头，保留到本批发送完毕。
+//内存不足取不到时返回false，由调用者放弃生成响应
+bool http_conn::next_write_chunk()
+{
+    int capacity;
+    char *buf = buffer_pool::get_instance()->get(WRITE_BUFFER_SIZE, capacity);
+    if (!buf)
+        return false;
+    m_write_buf = buf;
+    m_write_chunk[m_write_chunks++] = m_write_buf;
+    m_write_idx   = 0;
+    m_write_start = 0;
+    return true;
 }
 
 
@@ -166,7 +313,9 @@ void http_conn::__init()
 //非阻塞ET工作模式下，需要一次性将数据读完
 bool http_conn::read_once()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)
+    // 读缓冲区已满说明其中没有完整的请求（否则已被处理并腾出空间），换用更大的缓冲区；
+    // 请求超过最大规格时关闭连接
+    if (m_read_idx >= m_read_size && !grow_read_buf())
     {
         return false;
     }
@@ -175,7 +324,8 @@ bool http_conn::read_once()
     //LT读取数据
     if (0 == m_TRIGMode)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
+        stats::get_instance()->add(stats::SYSCALL);
         m_read_idx += bytes_read;
         LOG_INFO("m_read_idx = %d", m_read_idx);
 
@@ -183,15 +333,19 @@ bool http_conn::read_once()
         {
             return false;
         }
+        m_read_buf[m_read_idx] = '\0';
 
         return true;
     }
     //ET读数据
     else
     {
-        while (true)
+        // 读缓冲区满时停止读取，先处理其中的流水线请求，重新注册读事件时内核会再次报告剩余数据
+        while (m_read_idx < m_read_size)
         {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            int space = m_read_size - m_read_idx;
+            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, space, 0);
+            stats::get_instance()->add(stats::SYSCALL);
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -203,54 +357,73 @@ bool http_conn::read_once()
                 return false;
             }
             m_read_idx += bytes_read;
+            m_read_buf[m_read_idx] = '\0';
+            // 没有读满说明接收队列已空，不必再用一次recv等到EAGAIN；此后到达的数据会产生新的边沿事件
+            if (bytes_read < space)
+                break;
         }
         return true;
     }
 }
 
+//将已由io_uring读入provided buffer的数据追加到读缓冲区，返回放入的字节数
+int http_conn::read_from(const char *data, int len)
+{
+    if (m_read_idx >= m_read_size && !grow_read_buf())
+        return 0;
+    if (len > m_read_size - m_read_idx)
+        len = m_read_size - m_read_idx;
+    memcpy(m_read_buf + m_read_idx, data, len);
+    m_read_idx += len;
+    m_read_buf[m_read_idx] = '\0';
+    return len;
+}
+
 
 //从状态机，用于分析出一行内容
 //返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
 // 对于正确的行，将其"\r\n"更改为"\0\0"，并让一根指针指向该行开头（在上一次处理中指向"\0\0"之后的位置），以取出改行
 http_conn::LINE_STATUS http_conn::parse_line()
 {
-    char temp;
     /* m_checked_idx指向buffer中当前正在分析的字节；m_read_idx指向buffer中客户数据的尾部的下一字节
-    buffer的 [0, m_checked_idx-1] 字节都已分析完毕，第 [m_checked_idx, m_read_idx-1] 字节由下面的循环逐个分析 */
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx)
+    buffer的 [0, m_checked_idx-1] 字节都已分析完毕，第 [m_checked_idx, m_read_idx-1] 字节由向量化扫描一次找到行尾，
+    同时记下行内第一个字段分隔符，请求行和请求头的解析不必再逐字节查找 */
+    int sep;
+    m_checked_idx = http_scan_line(m_read_buf, m_checked_idx, m_read_idx, &sep);
+    if (m_sep_idx < 0)
+        m_sep_idx = sep;
+    if (m_checked_idx == m_read_idx)
+        return LINE_OPEN;
+
+    // "\r\n"标志着一行的结束
+    if (m_read_buf[m_checked_idx] == '\r')
     {
-        // 获取当前要分析的字节
-        temp = m_read_buf[m_checked_idx];
-        // "\r\n"标志着一行的结束
-        if (temp == '\r')
+        // 如果'\r'是本次读取的最后一个字节，说明本次parse还未读取到一个完整的一行
+        if (m_checked_idx == m_read_idx - 1)
+            return LINE_OPEN;
+        // 如果'\r'是本次读取的最后一个字节，下一个字符是'\n'，说明本次parse已经读取到一个完整的一行
+        else if (m_read_buf[m_checked_idx + 1] == '\n')
         {
-            // 如果'\r'是本次读取的最后一个字节，说明本次parse还未读取到一个完整的一行
-            if (m_checked_idx == m_read_idx - 1)
-                return LINE_OPEN;
-            // 如果'\r'是本次读取的最后一个字节，下一个字符是'\n'，说明本次parse已经读取到一个完整的一行
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
-            {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            // 否则用户发送的http请求存在语法问题
-            else
-                return LINE_BAD;
+            m_line_sep = (m_sep_idx < 0) ? -1 : m_sep_idx - m_start_line;
+            m_sep_idx = -1;
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
-        else if (temp == '\n')
-        {
-            // 如果'\n'是本次读取的最后一个字节，上一个字符是'\r'，说明本次parse已经读取到一个完整的一行
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
-            {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
+        // 否则用户发送的http请求存在语法问题
+        else
             return LINE_BAD;
-        }
     }
-    return LINE_OPEN;
+    // 如果'\n'是本次读取的最后一个字节，上一个字符是'\r'，说明本次parse已经读取到一个完整的一行
+    if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
+    {
+        m_line_sep = (m_sep_idx < 0) ? -1 : m_sep_idx - m_start_line;
+        m_sep_idx = -1;
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
 
@@ -265,11 +438,11 @@ http_conn::LINE_STATUS http_conn::parse_line()
 // 其中空格可能为' '或'\t'，也有可能有多个空格
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 {
-    // 得到被请求的资源地址
-    m_url = strpbrk(text, " \t");
-    if (!m_url) {
+    // 得到被请求的资源地址：扫描行尾时已记下第一个分隔符，即请求方法之后的空格
+    if (m_line_sep < 0 || (text[m_line_sep] != ' ' && text[m_line_sep] != '\t')) {
         return BAD_REQUEST;
     }
+    m_url = text + m_line_sep;
     *m_url++ = '\0'; // 将该位置改为\0，用于将前面的请求方法取出
     m_url += strspn(m_url, " \t"); // 可能仍存在空格，将其跳过（）
 
@@ -327,31 +500,40 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
     {
         if (m_content_length != 0)
         {
+            // 请求体连同'\0'必须放得下最大规格的读缓冲区，否则永远读不完整
+            if (m_content_length > READ_BUFFER_MAX - 1 - m_checked_idx)
+                return BAD_REQUEST;
             m_check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
         return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+
+    // 扫描行尾时已记下头部名称后的':'，按名称长度分派，只对长度相符的名称做一次比较
+    int name_len = (m_line_sep >= 0 && text[m_line_sep] == ':') ? m_line_sep : -1;
+    char *value = text + name_len + 1;
+    value += strspn(value, " \t");
+    if (name_len == 10 && strncasecmp(text, "Connection", 10) == 0)
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
+        if (strcasecmp(value, "keep-alive") == 0)
         {
             m_linger = true;
         }
     }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
+    else if (name_len == 14 && strncasecmp(text, "Content-length", 14) == 0)
     {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
+        // 只接受十进制的非负整数，其后只能有空白
+        char *end;
+        errno = 0;
+        long len = strtol(value, &end, 10);
+        end += strspn(end, " \t");
+        if (end == value || *end != '\0' || errno == ERANGE || len < 0 || len > READ_BUFFER_MAX)
+            return BAD_REQUEST;
+        m_content_length = len;
     }
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    else if (name_len == 4 && strncasecmp(text, "Host", 4) == 0)
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        m_host = value;
     }
     else
     {
@@ -363,8 +545,11 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
 //判断http请求是否被完整读入
 http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
-    if (m_read_idx >= (m_content_length + m_checked_idx))
+    if (m_read_idx - m_checked_idx >= m_content_length)
     {
+        // m_checked_idx越过请求体，指向下一个流水线请求的开头，其首字节被'\0'覆盖，解析下一个请求前恢复
+        m_checked_idx += m_content_length;
+        m_content_next = m_read_buf[m_checked_idx];
         text[m_content_length] = '\0';
         //POST请求中最后为输入的用户名和密码
         m_string = text;
@@ -391,14 +576,22 @@ http_conn::HTTP_CODE http_conn::process_read()
         {
             ret = parse_request_line(text);
             if (ret == BAD_REQUEST)
+            {
+                // 请求行有语法错误时无法确定请求的边界，丢弃读缓冲区中剩余的数据
+                m_checked_idx = m_read_idx;
                 return BAD_REQUEST;
+            }
             break;
         }
         case CHECK_STATE_HEADER:
         {
             ret = parse_headers(text);
             if (ret == BAD_REQUEST)
+            {
+                // Content-Length无效时同样无法确定请求的边界
+                m_checked_idx = m_read_idx;
                 return BAD_REQUEST;
+            }
             else if (ret == GET_REQUEST)
             {
                 return do_request();
@@ -410,8 +603,8 @@ http_conn::HTTP_CODE http_conn::process_read()
             ret = parse_content(text);
             if (ret == GET_REQUEST)
                 return do_request();
-            line_status = LINE_OPEN;
-            break;
+            // 请求体尚未读完时直接返回，不能再由parse_line扫描请求体而移动m_checked_idx
+            return NO_REQUEST;
         }
         default:
             return INTERNAL_ERROR;
@@ -427,6 +620,10 @@ http_conn::HTTP_CODE http_conn::do_request()
     //printf("m_url:%s\n", m_url);
     const char *p = strrchr(m_url, '/');
 
+    // POST请求可能访问数据库，不在Reactor线程上处理
+    if (m_inline && cgi == 1)
+        return DEFERRED_REQUEST;
+
     //处理cgi
     if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
     {
@@ -434,49 +631,73 @@ http_conn::HTTP_CODE http_conn::do_request()
         //根据标志判断是登录检测还是注册检测
         char flag = m_url[1];
 
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
+        // 请求行的长度不再受读缓冲区大小的限制，按m_real_file的大小截断
+        snprintf(m_real_file + len, FILENAME_LEN - len, "/%s", m_url + 2);
 
-        //将用户名和密码提取出来
+        //将用户名和密码提取出来，超长的截断
         //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
+        char name[SQL_PARAM_LEN], password[SQL_PARAM_LEN];
+        int i, j = 0;
+        for (i = 5; m_string[i] != '&' && m_string[i] != '\0'; ++i)
+            if (j < SQL_PARAM_LEN - 1)
+                name[j++] = m_string[i];
+        name[j] = '\0';
+
+        j = 0;
+        if (m_string[i] == '&')
+            for (i = i + 10; m_string[i] != '\0'; ++i)
+                if (j < SQL_PARAM_LEN - 1)
+                    password[j++] = m_string[i];
         password[j] = '\0';
 
         if (*(p + 1) == '3')
         {
             //如果是注册，先检测数据库中是否有重名的
             //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
+            //用户表由所有工作线程共享，查找和插入都在锁内进行
+            int res = 1;
+            bool executed = false;
+            m_lock.lock();
+            bool exists = users.find(name) != users.end();
+            m_lock.unlock();
+            if (m_sql_state == SQL_DONE && m_sql_gen == get_generation())
+            {
+                //非阻塞查询已完成，从暂停处继续
+                m_sql_state = SQL_NONE;
+                res = m_sql_ret;
+                executed = true;
+            }
+            else if (!exists)
+            {
+                //非阻塞查询：请求暂停在此，处理完毕后提交，查询完成时由工作线程重新进入do_request
+                if (m_sqlAsync)
+                {
+                    strcpy(m_sql_name, name);
+                    strcpy(m_sql_passwd, password);
+                    m_sql_state = SQL_QUEUED;
+                    return DEFERRED_REQUEST;
+                }
+
+                //静态资源和登录请求都不访问数据库，只在此处取用连接，且在加锁前取得，避免持锁等待连接池
+                MYSQL *mysql = NULL;
+                connectionRAII mysqlcon(&mysql, m_connPool);
+
+                //锁只保护内存中的用户表，数据库往返期间不持锁，慢查询不会使其他注册请求排队
+                //用户名和密码作为参数绑定到连接上预编译的语句，不拼接进SQL
+                const char *params[] = { name, password };
+                res = m_connPool->Execute(mysql, STMT_REGISTER, params, 2);
+                executed = true;
+            }
+
+            //只有插入成功才记入用户表，数据库不可达或重名时插入失败，用户表不变
+            if (executed && !res)
             {
                 m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
                 users.insert(pair<string, string>(name, password));
                 m_lock.unlock();
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
             }
+            if (executed && !res)
+                strcpy(m_url, "/log.html");
             else
                 strcpy(m_url, "/registerError.html");
         }
@@ -484,7 +705,11 @@ http_conn::HTTP_CODE http_conn::do_request()
         //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
         else if (*(p + 1) == '2')
         {
-            if (users.find(name) != users.end() && users[name] == password)
+            m_lock.lock();
+            map<string, string>::iterator it = users.find(name);
+            bool matched = it != users.end() && it->second == password;
+            m_lock.unlock();
+            if (matched)
                 strcpy(m_url, "/welcome.html");
             else
                 strcpy(m_url, "/logError.html");
@@ -534,6 +759,26 @@ http_conn::HTTP_CODE http_conn::do_request()
     else
         strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
 
+    // 命中文件缓存时直接使用缓存的stat结果、映射和fd
+    // Reactor线程上先只查找；未命中时大文件的打开和映射交给线程池，小文件照常打开并放入缓存
+    m_file = file_cache::get_instance()->acquire(m_real_file, !m_inline);
+    if (!m_file && m_inline)
+    {
+        if (stat(m_real_file, &m_file_stat) == 0 && S_ISREG(m_file_stat.st_mode) &&
+            m_file_stat.st_size > INLINE_FILE_MAX)
+            return DEFERRED_REQUEST;
+        m_file = file_cache::get_instance()->acquire(m_real_file);
+    }
+    if (m_file)
+    {
+        m_file_stat = m_file->st;
+        if (m_zero_copy)
+            m_file_fd = m_file->fd;
+        else
+            m_file_address = m_file->address;
+        return FILE_REQUEST;
+    }
+
     if (stat(m_real_file, &m_file_stat) < 0)
         return NO_RESOURCE;
 
@@ -544,79 +789,189 @@ http_conn::HTTP_CODE http_conn::do_request()
         return BAD_REQUEST;
 
     int fd = open(m_real_file, O_RDONLY);
+    // sendfile模式直接由内核从页缓存发送，不建立映射
+    if (m_zero_copy)
+    {
+        m_file_fd = fd;
+        return FILE_REQUEST;
+    }
     m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     close(fd);
     return FILE_REQUEST;
 }
 
 
+void http_conn::release_file(char *address, int fd, off_t size, file_entry *file)
+{
+    if (file)
+    {
+        file_cache::get_instance()->release(file);
+        return;
+    }
+    if (address)
+        munmap(address, size);
+    if (fd >= 0)
+        close(fd);
+}
+
 void http_conn::unmap()
 {
-    if (m_file_address)
+    for (int i = 0; i < m_resp_count; ++i)
+        release_file(m_resp[i].file_address, m_resp[i].file_fd, m_resp[i].file_size, m_resp[i].file);
+    m_resp_count = 0;
+
+    // 尚未加入本批的当前请求
+    release_file(m_file_address, m_file_fd, m_file_stat.st_size, m_file);
+    m_file = NULL;
+    m_file_address = 0;
+    m_file_fd = -1;
+}
+
+void http_conn::push_response()
+{
+    response &resp    = m_resp[m_resp_count++];
+    resp.file_address = m_file_address;
+    resp.file_fd      = m_file_fd;
+    resp.file_size    = m_file_stat.st_size;
+    resp.file         = m_file;
+    m_keep_alive      = m_linger;
+
+    m_file = NULL;
+    m_file_address = 0;
+    m_file_fd = -1;
+}
+
+void http_conn::add_iv(void *base, size_t len, int fd)
+{
+    if (len == 0)
+        return;
+    bytes_to_send += len;
+    // 与上一段在内存中相连时合并，例如连续的错误响应都在m_write_buf中
+    if (fd < 0 && m_iv_count > 0 && m_iv_fd[m_iv_count - 1] < 0 &&
+        (char *)m_iv[m_iv_count - 1].iov_base + m_iv[m_iv_count - 1].iov_len == base)
     {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+        m_iv[m_iv_count - 1].iov_len += len;
+        return;
     }
+    m_iv[m_iv_count].iov_base = base;
+    m_iv[m_iv_count].iov_len  = len;
+    m_iv_fd[m_iv_count]       = fd;
+    m_iv_off[m_iv_count]      = 0;
+    ++m_iv_count;
 }
+
 bool http_conn::write()
 {
-    int temp = 0;
-
     if (bytes_to_send == 0)
     {
+        init_batch();
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        __init();
         return true;
     }
 
-    while (1)
+    int ret = send_batch();
+    if (ret < 0)
+        return false;
+    if (ret == 0)
     {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+        return true;
+    }
+    return finish_write();
+}
 
-        if (temp < 0)
-        {
-            if (errno == EAGAIN)
-            {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
-                return true;
-            }
-            unmap();
-            return false;
-        }
+int http_conn::send_batch()
+{
+    int temp = 0;
 
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-        if (bytes_have_send >= m_iv[0].iov_len)
+    while (1)
+    {
+        int fd = m_iv_fd[m_iv_idx];
+        if (fd >= 0)
         {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
+            // sendfile模式的文件内容，从该段已发送到的偏移处继续
+            off_t offset = m_iv_off[m_iv_idx];
+            temp = sendfile(m_sockfd, fd, &offset, m_iv[m_iv_idx].iov_len);
         }
         else
         {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
+            // 连续的内存段一次发出；后面还有sendfile发送的文件内容时带MSG_MORE，
+            // 使内核把响应头与文件内容合并成满的报文段再发出
+            int n = 1;
+            while (m_iv_idx + n < m_iv_count && m_iv_fd[m_iv_idx + n] < 0)
+                ++n;
+            if (m_iv_idx + n < m_iv_count)
+            {
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov    = m_iv + m_iv_idx;
+                msg.msg_iovlen = n;
+                temp = sendmsg(m_sockfd, &msg, MSG_MORE);
+            }
+            else
+                temp = writev(m_sockfd, m_iv + m_iv_idx, n);
         }
+        stats::get_instance()->add(stats::SYSCALL);
 
-        if (bytes_to_send <= 0)
+        if (temp < 0)
         {
+            if (errno == EAGAIN)
+                return 0;
             unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+            return -1;
+        }
 
-            if (m_linger)
-            {
-                __init();
-                return true;
-            }
+        consume_iv(temp);
+        if (bytes_to_send <= 0)
+            return 1;
+    }
+}
+
+void http_conn::consume_iv(int bytes)
+{
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+    while (bytes > 0 && m_iv_idx < m_iv_count)
+    {
+        struct iovec &iv = m_iv[m_iv_idx];
+        if ((size_t)bytes < iv.iov_len)
+        {
+            if (m_iv_fd[m_iv_idx] >= 0)
+                m_iv_off[m_iv_idx] += bytes;
             else
-            {
-                return false;
-            }
+                iv.iov_base = (char *)iv.iov_base + bytes;
+            iv.iov_len -= bytes;
+            return;
         }
+        bytes -= iv.iov_len;
+        iv.iov_len = 0;
+        ++m_iv_idx;
+    }
+}
+
+bool http_conn::finish_write()
+{
+    unmap();
+
+    // 短连接不再重新注册读事件：连接即将被关闭，避免关闭前又被分发给其他工作线程
+    if (m_keep_alive)
+    {
+        init_batch();
+        // 读缓冲区中还有流水线请求时由调用者继续处理，处理完毕后再注册事件
+        if (!has_pending_request())
+            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return true;
     }
+    return false;
 }
 bool http_conn::add_response(const char *format, ...)
 {
+    // 每个响应的响应头开始写入时才取写缓冲区，直接发送缓存的完整响应时不需要；
+    // 当前块余量不足时换用新块，保证一个响应头不跨块
+    // 取不到写缓冲区时生成响应失败，由调用者关闭连接
+    if ((!m_write_buf || (m_write_idx == m_write_start && WRITE_BUFFER_SIZE - m_write_idx < WRITE_RESERVE)) &&
+        !next_write_chunk())
+        return false;
     if (m_write_idx >= WRITE_BUFFER_SIZE)
         return false;
     va_list arg_list;
@@ -634,6 +989,11 @@ bool http_conn::add_response(const char *format, ...)
 
     return true;
 }
+int http_conn::file_header(char *buf, int size, long long content_length, bool linger)
+{
+    return snprintf(buf, size, "%s %d %s\r\nContent-Length:%lld\r\nConnection:%s\r\n\r\n",
+                    "HTTP/1.1", 200, ok_200_title, content_length, linger ? "keep-alive" : "close");
+}
 bool http_conn::add_status_line(int status, const char *title)
 {
     return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
@@ -693,16 +1053,30 @@ bool http_conn::process_write(HTTP_CODE ret)
     }
     case FILE_REQUEST:
     {
+        // 命中预先生成的完整响应：不格式化响应头，整个响应作为一段加入本批
+        if (m_file && m_file->response[m_linger])
+        {
+            stats::get_instance()->add(stats::RESPONSE_CACHE_HIT);
+            add_iv(m_file->response[m_linger], m_file->response_len[m_linger]);
+            return true;
+        }
+
         add_status_line(200, ok_200_title);
         if (m_file_stat.st_size != 0)
         {
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            // 未命中只统计本可以预先生成完整响应的文件，超过大小上限的另行计数
+            if (file_cache::get_instance()->response_cacheable(m_file_stat.st_size))
+                stats::get_instance()->add(stats::RESPONSE_CACHE_MISS);
+            else
+                stats::get_instance()->add(stats::RESPONSE_CACHE_SKIP);
+            if (!add_headers(m_file_stat.st_size))
+                return false;
+            add_iv(m_write_buf + m_write_start, m_write_idx - m_write_start);
+            // sendfile模式下文件内容由write用sendfile发送
+            if (m_file_fd >= 0)
+                add_iv(NULL, m_file_stat.st_size, m_file_fd);
+            else
+                add_iv(m_file_address, m_file_stat.st_size);
             return true;
         }
         else
@@ -711,29 +1085,216 @@ bool http_conn::process_write(HTTP_CODE ret)
             add_headers(strlen(ok_string));
             if (!add_content(ok_string))
                 return false;
+            break;
         }
     }
     default:
         return false;
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    add_iv(m_write_buf + m_write_start, m_write_idx - m_write_start);
     return true;
 }
-void http_conn::process()
+bool http_conn::process()
 {
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST)
+    // 请求暂停时提交查询，否则生成响应失败，关闭连接。两者之后连接都可能已属于其他线程，不能再访问
+    if (!process_batch())
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        return;
+        if (m_deferred)
+            return !park();
+        if (m_persist)
+            shut();
+        else
+            close_conn();
+        return true;
     }
-    bool write_ret = process_write(read_ret);
-    if (!write_ret)
+
+    // 所有权模式：不重新注册事件，立即尝试发送。advance中暂停的请求由它自己提交，
+    // 此后连接可能已属于其他线程，这里不能再访问；所有权模式不用于io_uring后端，调用者不需要区分
+    if (m_persist)
     {
-        close_conn();
+        advance(false, true);
+        return true;
+    }
+    if (m_resp_count == 0)
+    {
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return true;
     }
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    return true;
+}
+
+bool http_conn::process_batch()
+{
+    // 流水线：逐个处理读缓冲区中已完整读入的请求，各响应追加到同一批中一次发出。
+    // 本批已满时先发送，剩余的请求在本批发送完毕后继续处理
+    while (m_resp_count < MAX_PIPELINE)
+    {
+        HTTP_CODE read_ret;
+        if (m_deferred)
+        {
+            // Reactor线程已解析完的请求，或非阻塞查询已完成的请求，从do_request继续
+            m_deferred = false;
+            read_ret = do_request();
+        }
+        else
+            read_ret = process_read();
+        if (read_ret == NO_REQUEST)
+            break;
+        // 留给工作线程，不注册事件，由调用者交给线程池；或等待查询，由调用者提交
+        if (read_ret == DEFERRED_REQUEST)
+        {
+            m_deferred = true;
+            return false;
+        }
+
+        // 由调用者关闭连接
+        if (!process_write(read_ret))
+            return false;
+        stats::get_instance()->add(stats::REQUEST);
+        if (m_resp_count > 0)
+            stats::get_instance()->add(stats::REQUEST_PIPELINED);
+        push_response();
+        init_request();
+        // 短连接的响应之后不再处理后续请求
+        if (!m_keep_alive)
+            break;
+    }
+    return true;
+}
+
+bool http_conn::acquire()
+{
+    int state = OWNER_IDLE;
+    if (m_owner.compare_exchange_strong(state, OWNER_BUSY))
+        return true;
+    while (state == OWNER_BUSY && !m_owner.compare_exchange_weak(state, OWNER_PENDING))
+        ;
+    return false;
+}
+
+bool http_conn::release()
+{
+    int state = OWNER_BUSY;
+    if (m_owner.compare_exchange_strong(state, OWNER_IDLE))
+        return true;
+    // 持有期间到达的事件已由Reactor登记为OWNER_PENDING，清除登记后由调用者再检查一次
+    m_owner.store(OWNER_BUSY);
+    return false;
+}
+
+// 持有者不能自己关闭连接(定时器归Reactor所有)：先shutdown再转入关闭状态。转入关闭状态之后，
+// Reactor随时可能因随后的事件关闭fd、把连接对象交给新连接，因此先取出fd和代数，之后只用副本。
+// shutdown产生的事件可能在转入关闭状态之前到达而只被登记为OWNER_PENDING，不能指望它，
+// 由关闭记录通知Reactor；连接已被Reactor关闭时记录的代数不同，Reactor丢弃该记录
+void http_conn::shut()
+{
+    int sockfd = m_sockfd;
+    unsigned int generation = get_generation();
+    completion_queue *closed = m_closed;
+
+    shutdown(sockfd, SHUT_RDWR);
+    stats::get_instance()->add(stats::SYSCALL);
+    int state = m_owner.exchange(OWNER_CLOSING);
+    assert(state == OWNER_BUSY || state == OWNER_PENDING);
+    (void)state;
+    if (closed)
+        closed->push(sockfd, generation, false);
+}
+
+bool http_conn::advance(bool readable, bool can_process)
+{
+    if (readable)
+        m_want_read = true;
+    while (true)
+    {
+        if (bytes_to_send > 0)
+        {
+            int ret = send_batch();
+            if (ret < 0)
+            {
+                shut();
+                return false;
+            }
+            if (ret > 0)
+            {
+                unmap();
+                if (!m_keep_alive)
+                {
+                    shut();
+                    return false;
+                }
+                init_batch();
+            }
+        }
+
+        // 本批尚未发送完时不读也不处理，等发送缓冲区腾出空间后的事件
+        if (bytes_to_send == 0)
+        {
+            int read_idx = m_read_idx;
+            if (m_want_read)
+            {
+                if (!read_once())
+                {
+                    shut();
+                    return false;
+                }
+                // 读缓冲区被读满时接收队列中可能还有数据，ET模式下不会再有事件，处理后再读
+                m_want_read = m_read_idx >= m_read_size;
+            }
+            if (m_read_idx > read_idx || has_pending_request())
+            {
+                if (!can_process)
+                    return true;
+                // 请求暂停时提交查询，否则生成响应失败，关闭连接
+                if (!process_batch())
+                {
+                    if (m_deferred)
+                        park();
+                    else
+                        shut();
+                    return false;
+                }
+                if (bytes_to_send > 0)
+                    continue;
+            }
+            if (m_want_read)
+                continue;
+        }
+
+        if (release())
+            return false;
+        // 持有期间有新的事件到达，不知道是可读还是可写，都再试一次
+        m_want_read = true;
+    }
+}
+
+// 连接的所有访问都已结束后才提交，查询完成时另一个工作线程可能立即从do_request继续
+bool http_conn::park()
+{
+    if (m_sql_state != SQL_QUEUED)
+        return false;
+    m_sql_state = SQL_WAITING;
+    const char *params[] = { m_sql_name, m_sql_passwd };
+    m_sqlAsync->submit(this, STMT_REGISTER, params, 2);
+    return true;
+}
+
+// 先检查代数再写回结果；查询线程是连接对象的使用者(见sql_async::submit)，检查之后连接即使关闭，对象也不会被新连接复用
+bool http_conn::sql_done(unsigned int generation, int ret)
+{
+    if (get_generation() != generation)
+        return false;
+    m_sql_ret = ret;
+    m_sql_gen = generation;
+    m_sql_state = SQL_DONE;
+    return true;
+}
+
+bool http_conn::process_inline()
+{
+    m_inline = true;
+    process();
+    m_inline = false;
+    return !m_deferred;
 }
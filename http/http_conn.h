@@ -19,20 +19,32 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <atomic>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
+#include "../CGImysql/sql_async.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../cache/file_cache.h"
+#include "../buffer/buffer_pool.h"
+#include "../threadpool/completion_queue.h"
+#include "http_scan.h"
 
 
 class http_conn
 {
 public:
     static const int FILENAME_LEN = 200;        // 设置读取文件的名称m_real_file大小
-    static const int READ_BUFFER_SIZE = 2048;   // 设置读缓冲区m_read_buf大小
-    static const int WRITE_BUFFER_SIZE = 1024;  // 设置写缓冲区m_write_buf大小
+    static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区m_read_buf的初始规格，放不下时换用加倍的规格
+    static const int READ_BUFFER_MAX = buffer_pool::MAX_SIZE; // 读缓冲区的最大规格，单个请求超过此大小时关闭连接
+    static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区m_write_buf每块的大小
+    static const int MAX_PIPELINE = 16;         // 一批writev中最多合并的流水线请求的响应数
+    static const int WRITE_RESERVE = 256;       // 当前块余量低于此值时换用新块（足够容纳一个错误响应）
+    static const int INLINE_FILE_MAX = 64 * 1024; // 混合模式下Reactor线程自己打开的未缓存文件的大小上限
+    static const int SQL_PARAM_LEN = 100;       // 注册请求的用户名、密码的最大长度(含'\0')，超长的截断
 
     // HTTP请求方法(只用到了POST和GET)
     enum METHOD
@@ -66,7 +78,26 @@ public:
         FORBIDDEN_REQUEST,     // 客户对资源没有足够的访问权限
         FILE_REQUEST,          // 文件请求
         INTERNAL_ERROR,        // 服务器内部错误
-        CLOSED_CONNECTION      // 客户端已经关闭连接
+        CLOSED_CONNECTION,     // 客户端已经关闭连接
+        DEFERRED_REQUEST       // 暂停处理的请求：混合模式下需交给线程池处理（访问数据库或打开大文件），或在等待非阻塞查询的结果
+    };
+
+    // 非阻塞查询的进度
+    enum SQL_STATE
+    {
+        SQL_NONE = 0,   // 没有查询
+        SQL_QUEUED,     // do_request已生成语句并暂停，持有连接的线程处理完毕后提交
+        SQL_WAITING,    // 已提交给查询线程
+        SQL_DONE        // 查询已完成，结果在m_sql_ret中，等待工作线程从do_request继续
+    };
+
+    // 所有权模式下连接的归属：同一时刻只有一个线程(Reactor或工作线程)处理连接的I/O
+    enum OWNER
+    {
+        OWNER_IDLE = 0, // 无人处理，Reactor收到事件时取得所有权
+        OWNER_BUSY,     // 有线程正在处理
+        OWNER_PENDING,  // 有线程正在处理，期间又到达了事件，持有者交出所有权前须再检查一次
+        OWNER_CLOSING   // 持有者已决定关闭连接，由Reactor收到关闭记录或随后的事件时关闭
     };
 
     // 从状态机的状态
@@ -79,18 +110,40 @@ public:
 
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_generation(0), m_users(0), m_read_buf(NULL), m_read_size(0), m_read_idx(0), m_write_buf(NULL), m_write_chunks(0),
+                  m_file_address(NULL), m_file_fd(-1), m_file(NULL), m_resp_count(0), m_inline(false), m_deferred(false),
+                  m_persist(false), m_want_read(false), m_owner(OWNER_IDLE), m_closed(NULL), m_sql_state(SQL_NONE) {}
+    ~http_conn() { unmap(); free_buffers(); }
 
 public:
     // 初始化套接字地址，函数内部会调用私有方法init
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);
-
-    // 关闭http连接（该函数只被内部的process函数调用）
+    // epollfd为该连接所属的epoll内核事件表（多Reactor模式下每个从Reactor各有一个）
+    // zero_copy为1时文件内容用sendfile发送，为0时mmap后用writev发送
+    // persist为true时使用所有权模式：读写事件以ET模式一次注册，不再用EPOLLONESHOT逐次重新注册，
+    // 持有者决定关闭连接时向closed(所属Reactor的完成队列)提交关闭记录
+    void init(int sockfd, const sockaddr_in &addr, int epollfd, char *, int, int, int zero_copy = 0, bool persist = false,
+              completion_queue *closed = NULL);
+
+    // 关闭http连接（该函数只被内部的process函数调用），由连接所属的Reactor完成关闭
     void close_conn(bool real_close = true);
 
-    // 处理
-    void process();
+    // 处理；请求暂停等待非阻塞查询时返回false，此时连接已交给查询线程，调用者不能再访问它
+    bool process();
+
+    // 所有权模式：Reactor收到连接的事件时调用，连接空闲时取得所有权返回true；
+    // 否则把事件登记给持有者，由其在交出所有权前处理，返回false
+    bool acquire();
+    // 持有者已决定关闭连接
+    bool closing() { return m_owner.load() == OWNER_CLOSING; }
+    // 所有权模式下持有连接的线程调用：发送积压的响应，读入新数据，处理其中完整的请求并立即尝试发送，
+    // 直到无事可做(发送缓冲区已满或没有新数据)时交出所有权。readable为true时先读一次。
+    // can_process为false(Reactor线程)时读入新请求后不处理，返回true，由调用者交给线程池，所有权随之转交；
+    // 需要关闭连接时转入关闭状态并返回false
+    bool advance(bool readable, bool can_process);
+
+    // 混合模式：在Reactor线程上处理，只处理能快速完成的请求。遇到需要交给线程池的请求时返回false，
+    // 该请求已解析完毕，之前的响应已加入本批，由工作线程调用process从该请求继续
+    bool process_inline();
 
     // 读取浏览器端发来的全部数据
     bool read_once();
@@ -98,22 +151,90 @@ public:
     // 发送响应报文
     bool write();
 
+    // io_uring后端使用：读入由provided buffer ring交付的数据，I/O本身由事件循环提交
+    // 读缓冲区放不下时只读入一部分，返回读入的字节数
+    int read_from(const char *data, int len);
+    // io_uring后端使用：取出待发送的iovec，发送bytes字节后调用consume_iv推进
+    bool has_pending_write() { return bytes_to_send > 0; }
+    struct iovec* get_iovec(int &count) { count = m_iv_count - m_iv_idx; return m_iv + m_iv_idx; }
+    void consume_iv(int bytes);
+    // 本批响应发送完毕，返回是否保持连接
+    // 读缓冲区中还有未处理的流水线请求时不重新注册读事件，由调用者再次调用process
+    bool finish_write();
+    // 本批响应已发送完毕，且读缓冲区中还有尚未解析的流水线请求
+    bool has_pending_request()
+    {
+        return bytes_to_send == 0 && m_checked_idx < m_read_idx && m_check_state != CHECK_STATE_CONTENT;
+    }
+    // 当前请求是否是访问数据库的POST请求(登录、注册)，线程池据此把它放入数据库通道，
+    // 只看已读入的请求方法，读入请求行之前调用时返回false。
+    // 启用非阻塞查询时工作线程不等待数据库，不需要单独的通道
+    bool is_db_request()
+    {
+        return !m_sqlAsync && m_read_idx - m_request_start >= 5 && memcmp(m_read_buf + m_request_start, "POST ", 5) == 0;
+    }
+    // 查询线程调用：generation为提交时的连接代数，连接已关闭时返回false，否则记下结果，由调用者交还线程池
+    bool sql_done(unsigned int generation, int ret);
+    // 释放本批所有响应的文件映射（sendfile模式下为关闭文件，文件来自缓存时为释放引用）
+    void unmap();
+    // 把读写缓冲区归还缓冲区池（连接关闭后调用，读缓冲区中未处理的数据一并丢弃）
+    void free_buffers();
+
     // 返回服务器上的文件地址
     sockaddr_in* get_address() { return &m_address; }
+    int get_sockfd() { return m_sockfd; }
+    // 连接代数，每个新连接取全局递增的值，用于识别属于旧连接的迟到事件
+    // （连接对象在slab中复用，同一fd上的先后两个连接可能是不同的对象，因此不能按对象各自计数）
+    // 工作线程在取出排队的任务时读取，与关闭连接的Reactor线程并发
+    unsigned int get_generation() { return m_generation.load(std::memory_order_relaxed); }
+    // 连接已关闭(由连接表在归还连接对象时调用)：代数清零，仍在工作队列中的任务据此识别为已失效
+    void invalidate() { m_generation.store(0); }
+    // 工作线程和查询线程访问连接对象期间登记为使用者，连接关闭时仍有使用者的对象暂不复用(见conn_table::remove)。
+    // enter先登记再检查代数，与invalidate之后检查使用者的连接表总有一方看到另一方：
+    // 连接仍属于generation时返回true，否则撤销登记返回false。hold供已是使用者的线程把连接转交给其他线程
+    bool enter(unsigned int generation)
+    {
+        m_users.fetch_add(1);
+        if (m_generation.load() == generation)
+            return true;
+        m_users.fetch_sub(1);
+        return false;
+    }
+    void hold() { m_users.fetch_add(1); }
+    void leave() { m_users.fetch_sub(1); }
+    bool in_use() { return m_users.load() != 0; }
 
-    // 同步线程初始化数据库读取表
-    void initmysql_result(sql_connection_pool *connPool);
+    // 同步线程初始化数据库读取表（所有连接共享的用户表，启动时读取一次）
+    // sqlAsync不为NULL时注册请求的INSERT交给它非阻塞执行，不在工作线程上等待数据库
+    static void initmysql_result(sql_connection_pool *connPool, int close_log, sql_async *sqlAsync = NULL);
 
+    // 生成与process_write相同的200文件响应头，供文件缓存预先生成完整响应
+    static int file_header(char *buf, int size, long long content_length, bool linger);
 
-    // improv和timer_flag的作用为“Reactor模式下，当子线程执行读写任务出错时，来通知主线程关闭子线程的客户连接”。
-    //      对于improv标志，其作用是保持主线程和子线程的同步；
-    //      对于time_flag标志，其作用是标识子线程读写任务是否成功。
-    int timer_flag;
-    int improv;
 
 
 private:
+    // 一批响应中一个响应持有的文件资源，整批发送完毕后统一释放
+    struct response
+    {
+        char*        file_address;
+        int          file_fd;
+        off_t        file_size;
+        file_entry*  file;
+    };
+
     void __init();
+    void init_request();                        // 重置单个请求的解析状态，从m_checked_idx处开始解析下一个请求
+    void init_batch();                          // 本批响应发送完毕：清空写缓冲区，把未处理的字节移到读缓冲区开头
+    void push_response();                       // 当前请求的响应加入本批，转移其文件资源
+    void release_file(char *address, int fd, off_t size, file_entry *file);
+    bool grow_read_buf();                       // 读缓冲区已满时换用加倍规格的缓冲区，已是最大规格时返回false
+    bool next_write_chunk();                    // 从缓冲区池取一块新的写缓冲区，之前的块在本批发送完毕前保留；取不到时返回false
+    bool process_batch();                       // 处理读缓冲区中完整的请求，连接已关闭或请求留给工作线程时返回false
+    int send_batch();                           // 发送本批响应，出错返回-1，发送缓冲区已满返回0，发送完毕返回1
+    bool release();                             // 交出所有权，持有期间有新事件到达时返回false，仍持有连接
+    void shut();                                // shutdown后转入关闭状态，通知Reactor关闭连接
+    bool park();                                // 请求在等待查询时提交注册语句，连接交给查询线程，返回true
 // process
     HTTP_CODE process_read();                   // 从m_read_buf读取，并处理请求报文
     LINE_STATUS parse_line();                   // 从状态机读取一行，分析是请求报文的哪一部分
@@ -134,26 +255,40 @@ private:
     bool add_content_length(int content_length);
     bool add_linger();
     bool add_blank_line();
+    // 向本批追加一段待发送的数据，fd不为-1时表示该段由sendfile从文件开头发送
+    void add_iv(void *base, size_t len, int fd = -1);
 
-// write
-    void unmap();
 public:
-    static int m_epollfd;
-    static int m_user_count;
-    MYSQL*     mysql;
+    static std::atomic<int> m_user_count; // 多个Reactor线程和工作线程会并发增减
+    int        m_epollfd;
     int        m_state; // 读为0, 写为1
 
 private:
+    static sql_connection_pool* m_connPool; // 只有处理注册请求时才从连接池中按需取用连接
+    static sql_async* m_sqlAsync;           // 非阻塞查询，未启用时为NULL
+    static std::atomic<unsigned int> m_next_generation;
+
     int          m_sockfd;
     sockaddr_in  m_address;
+    std::atomic<unsigned int> m_generation;
+    std::atomic<int>          m_users;          // 正在访问连接对象的工作线程和查询线程数，见enter
 
-    char         m_read_buf[READ_BUFFER_SIZE];      // 存储读取的请求报文数据
+    char*        m_read_buf;                        // 存储读取的请求报文数据，数据之后总有一个'\0'；没有数据时归还缓冲区池，为NULL
+    int          m_read_size;                       // m_read_buf最多存放的数据字节数（规格减去'\0'的一个字节）
     int          m_read_idx;                        // m_read_buf中数据的最后一个字节的下一个位置
-    int          m_checked_idx;                     // m_read_buf读取的位置m_checked_idx
+    int          m_checked_idx;                     // m_read_buf读取的位置m_checked_idx，请求完整时指向下一个请求的开头
     int          m_start_line;                      // m_read_buf中已经解析的字符个数
-
-    char         m_write_buf[WRITE_BUFFER_SIZE];    // 存储发出的响应报文数据
-    int          m_write_idx;                       // 指示buffer中的长度
+    int          m_request_start;                   // 当前请求在m_read_buf中的起始位置
+    char         m_content_next;                    // 请求体末尾写入'\0'时覆盖的字节（下一个流水线请求的首字节）
+    int          m_sep_idx;                         // 当前行中第一个字段分隔符在m_read_buf中的位置，尚未找到为-1
+    int          m_line_sep;                        // 刚解析完的一行中第一个字段分隔符相对行首的偏移，没有为-1
+
+    // 本批各响应的响应头依次存放在从缓冲区池取得的若干块中，本批的iovec指向这些块，整批发送完毕后一并归还
+    char*        m_write_buf;                       // 当前块，本批还没有响应时为NULL
+    char*        m_write_chunk[MAX_PIPELINE];       // 本批取得的所有块，每个响应至多新取一块
+    int          m_write_chunks;
+    int          m_write_idx;                       // 当前块中的长度
+    int          m_write_start;                     // 当前请求的响应头在当前块中的起始位置
 
     CHECK_STATE  m_check_state;                     // 主状态机的状态
     METHOD       m_method;                          // 请求方法
@@ -167,22 +302,43 @@ private:
     bool         m_linger;
 
     char*        m_file_address;
+    int          m_file_fd;   // sendfile模式下打开的文件，发送完毕后关闭
+    int          m_zero_copy;
+    file_entry*  m_file;      // 来自文件缓存时持有的引用，映射和fd归缓存所有
     struct stat  m_file_stat;
-    struct iovec m_iv[2];
+
+    // 流水线：读缓冲区中所有完整请求的响应依次追加到同一批iovec中，一次writev发出
+    response     m_resp[MAX_PIPELINE];
+    int          m_resp_count;
+    bool         m_keep_alive;                  // 本批最后一个响应是否保持连接
+    struct iovec m_iv[2 * MAX_PIPELINE];
+    int          m_iv_fd[2 * MAX_PIPELINE];     // 由sendfile发送的段对应的文件，内存中的段为-1
+    off_t        m_iv_off[2 * MAX_PIPELINE];    // 由sendfile发送的段已发送到的文件偏移
     int          m_iv_count;
+    int          m_iv_idx;                      // 第一个尚未发送完的段
     int          cgi;      // 是否启用的POST
     char*        m_string; // 存储请求头数据
     int          bytes_to_send;     // 剩余发送字节数
     int          bytes_have_send;   // 已发送字节数
     char*        doc_root;
 
-    map<string, string> m_users;
-    int                 m_TRIGMode;
-    int                 m_close_log;
+    int          m_TRIGMode;
+    int          m_close_log;
+
+    bool         m_inline;      // 正在Reactor线程上处理，do_request只处理能快速完成的请求
+    bool         m_deferred;    // 当前请求已解析完毕、留给工作线程从do_request继续
+
+    bool             m_persist;     // 所有权模式
+    bool             m_want_read;   // 有尚未读取的数据(收到读事件时本批还没发送完，或读缓冲区曾被读满)
+    std::atomic<int> m_owner;       // 连接的归属，见OWNER
+    completion_queue *m_closed;     // 所属Reactor的完成队列，转入关闭状态后在此提交关闭记录
 
-    char sql_user[100];
-    char sql_passwd[100];
-    char sql_name[100];
+    // 非阻塞查询：连接关闭后查询线程可能仍会写回结果，由代数识别
+    std::atomic<int> m_sql_state;   // 见SQL_STATE
+    int              m_sql_ret;     // 执行语句的返回值，0为成功
+    unsigned int     m_sql_gen;     // 结果所属的连接代数
+    char             m_sql_name[SQL_PARAM_LEN];   // 等待查询期间保存的语句参数
+    char             m_sql_passwd[SQL_PARAM_LEN];
 };
 
 #endif
@@ -0,0 +1,155 @@
+#include "http_scan.h"
+
+#ifdef HTTP_SCAN_X86
+#include <immintrin.h>
+#endif
+
+// 字符分类：1为行尾，2为字段分隔符
+static unsigned char s_class[256];
+
+static bool init_class()
+{
+    s_class[(unsigned char)'\r'] = 1;
+    s_class[(unsigned char)'\n'] = 1;
+    s_class[(unsigned char)':'] = 2;
+    s_class[(unsigned char)' '] = 2;
+    s_class[(unsigned char)'\t'] = 2;
+    return true;
+}
+static bool s_class_ready = init_class();
+
+int http_scan_line_scalar(const char *buf, int begin, int end, int *sep)
+{
+    *sep = -1;
+    for (int i = begin; i < end; ++i)
+    {
+        unsigned char k = s_class[(unsigned char)buf[i]];
+        if (!k)
+            continue;
+        if (k == 1)
+            return i;
+        if (*sep < 0)
+            *sep = i;
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+
+// 不足一个向量的尾部交给更窄的实现，并合并分隔符结果
+static inline int scan_tail(int (*scan)(const char *, int, int, int *),
+                            const char *buf, int begin, int end, int *sep)
+{
+    int tail_sep;
+    int ret = scan(buf, begin, end, &tail_sep);
+    if (*sep < 0)
+        *sep = tail_sep;
+    return ret;
+}
+
+// 检查从i开始的16字节，找到行尾时返回其下标，否则返回-1
+static inline int scan16(const char *buf, int i, int *sep)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    unsigned eol = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                                                  _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    if (*sep < 0)
+    {
+        unsigned s = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                                                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))),
+                                                    _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+        // 只取行尾之前的分隔符
+        if (eol)
+            s &= (eol & -eol) - 1;
+        if (s)
+            *sep = i + __builtin_ctz(s);
+    }
+    return eol ? i + __builtin_ctz(eol) : -1;
+}
+
+// SSE2是x86-64的基本指令集，无需运行时检测
+int http_scan_line_sse2(const char *buf, int begin, int end, int *sep)
+{
+    *sep = -1;
+    int i = begin;
+    for (; i + 16 <= end; i += 16)
+    {
+        int eol = scan16(buf, i, sep);
+        if (eol >= 0)
+            return eol;
+    }
+    return scan_tail(http_scan_line_scalar, buf, i, end, sep);
+}
+
+__attribute__((target("avx2")))
+int http_scan_line_avx2(const char *buf, int begin, int end, int *sep)
+{
+    const __m256i cr    = _mm256_set1_epi8('\r');
+    const __m256i lf    = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i sp    = _mm256_set1_epi8(' ');
+    const __m256i tab   = _mm256_set1_epi8('\t');
+
+    *sep = -1;
+    int i = begin;
+    // 大多数请求头不足32字节，先用16字节探测一次，避免短行也付出32字节加载的代价
+    if (i + 16 <= end)
+    {
+        int eol = scan16(buf, i, sep);
+        if (eol >= 0)
+            return eol;
+        i += 16;
+    }
+    for (; i + 32 <= end; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        unsigned eol = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (*sep < 0)
+        {
+            unsigned s = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, colon),
+                                                                              _mm256_cmpeq_epi8(v, sp)),
+                                                              _mm256_cmpeq_epi8(v, tab)));
+            if (eol)
+                s &= (eol & -eol) - 1;
+            if (s)
+                *sep = i + __builtin_ctz(s);
+        }
+        if (eol)
+            return i + __builtin_ctz(eol);
+    }
+    return scan_tail(http_scan_line_sse2, buf, i, end, sep);
+}
+
+#endif
+
+typedef int (*scan_func)(const char *, int, int, int *);
+
+static const char *s_impl = "scalar";
+
+static scan_func resolve_scan()
+{
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        s_impl = "avx2";
+        return http_scan_line_avx2;
+    }
+    s_impl = "sse2";
+    return http_scan_line_sse2;
+#else
+    return http_scan_line_scalar;
+#endif
+}
+
+static scan_func s_scan = resolve_scan();
+
+int http_scan_line(const char *buf, int begin, int end, int *sep)
+{
+    return s_scan(buf, begin, end, sep);
+}
+
+const char *http_scan_impl()
+{
+    return s_impl;
+}
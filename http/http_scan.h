@@ -0,0 +1,21 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+// 请求行/请求头扫描：在buf的[begin, end)中查找行尾('\r'或'\n')，
+// 同时记录行尾之前第一个字段分隔符(':'、' '或'\t')的位置，一次遍历完成。
+// 返回行尾的下标，没有找到时返回end；*sep为分隔符下标，没有时为-1。
+// 启动时根据CPU选择AVX2(每次32字节)、SSE2(每次16字节)或逐字节查表的实现。
+int http_scan_line(const char *buf, int begin, int end, int *sep);
+
+// 各实现单独导出，供微基准测试比较
+int http_scan_line_scalar(const char *buf, int begin, int end, int *sep);
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HTTP_SCAN_X86 1
+int http_scan_line_sse2(const char *buf, int begin, int end, int *sep);
+int http_scan_line_avx2(const char *buf, int begin, int end, int *sep);
+#endif
+
+// 当前使用的实现名称
+const char *http_scan_impl();
+
+#endif
@@ -4,6 +4,8 @@
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <errno.h>
+#include <time.h>
 
 class sem
 {
@@ -20,6 +22,41 @@ public:
     }
     ~sem() { sem_destroy(&m_sem); }
     bool wait() { return sem_wait(&m_sem) == 0; }
+    // 不等待，计数为0时返回false
+    bool trywait() { return sem_trywait(&m_sem) == 0; }
+    // 最多等待ms毫秒，超时返回false。截止时刻按单调时钟计算，不受系统时间调整的影响，
+    // 被信号中断时继续等待到截止时刻
+    bool timewait(int ms) {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        t.tv_sec += ms / 1000;
+        t.tv_nsec += (long)(ms % 1000) * 1000000;
+        if (t.tv_nsec >= 1000000000) {
+            t.tv_sec++;
+            t.tv_nsec -= 1000000000;
+        }
+        while (true) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+            if (sem_clockwait(&m_sem, CLOCK_MONOTONIC, &t) == 0)
+                return true;
+#else
+            // 没有sem_clockwait时把剩余时间换算为CLOCK_REALTIME的截止时刻，每次被中断后重新换算
+            struct timespec now, abs;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long left = (t.tv_sec - now.tv_sec) * 1000000000LL + (t.tv_nsec - now.tv_nsec);
+            if (left <= 0)
+                return sem_trywait(&m_sem) == 0;
+            clock_gettime(CLOCK_REALTIME, &abs);
+            left += abs.tv_nsec;
+            abs.tv_sec += left / 1000000000;
+            abs.tv_nsec = left % 1000000000;
+            if (sem_timedwait(&m_sem, &abs) == 0)
+                return true;
+#endif
+            if (errno != EINTR)
+                return false;
+        }
+    }
     bool post() { return sem_post(&m_sem) == 0; }
 
 private:
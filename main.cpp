@@ -16,7 +16,12 @@ int main(int argc, char *argv[])
     //初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
                 config.OPT_LINGER, config.TRIGMode,  config.sql_num,  config.thread_num,
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.reactor_num,
+                config.event_backend, config.idle_timeout,
+                config.zero_copy, config.file_cache, config.max_conn,
+                config.work_steal, config.max_thread, config.db_thread,
+                config.hybrid, config.persist, config.async_sql,
+                config.affine_sql, config.sql_min);
 
     server.run();
 
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include "stats.h"
+
+static const char *counter_names[stats::COUNTER_NUM] =
+{
+    "conn_accept",
+    "conn_close",
+    "conn_alloc",
+    "conn_defer",
+    "sql_acquire",
+    "sql_wait_us",
+    "file_cache_hit",
+    "file_cache_miss",
+    "file_cache_skip",
+    "file_cache_evict",
+    "file_cache_stale",
+    "response_cache_hit",
+    "response_cache_miss",
+    "response_cache_skip",
+    "response_cache_bytes",
+    "request_pipelined",
+    "buffer_alloc",
+    "buffer_grow",
+    "buffer_bytes",
+    "work_steal",
+    "thread_count",
+    "thread_spawn",
+    "thread_retire",
+    "request_inline",
+    "work_stale",
+    "work_expired",
+    "request",
+    "syscall",
+    "sql_async",
+    "sql_pinned",
+    "sql_in_use",
+    "sql_free",
+    "sql_grow",
+    "sql_shrink",
+    "sql_reconnect",
+};
+
+static const char *histogram_names[stats::HISTOGRAM_NUM] =
+{
+    "queue_wait_us",
+    "queue_wait_db_us",
+    "sql_query_us",
+    "sql_acquire_us",
+};
+
+stats::stats()
+{
+    for (int i = 0; i < COUNTER_NUM; ++i)
+        m_counters[i] = 0;
+    for (int i = 0; i < HISTOGRAM_NUM; ++i)
+        for (int j = 0; j < BUCKET_NUM; ++j)
+            m_buckets[i][j] = 0;
+}
+
+long long stats::percentile(HISTOGRAM h, double p)
+{
+    long long count[BUCKET_NUM], total = 0;
+    for (int i = 0; i < BUCKET_NUM; ++i)
+    {
+        count[i] = m_buckets[h][i].load(std::memory_order_relaxed);
+        total += count[i];
+    }
+    if (!total)
+        return 0;
+
+    long long rank = (long long)(p * total), seen = 0;
+    for (int i = 0; i < BUCKET_NUM; ++i)
+    {
+        seen += count[i];
+        if (seen > rank)
+            return i ? (1LL << i) - 1 : 0;
+    }
+    return (1LL << (BUCKET_NUM - 1)) - 1;
+}
+
+int stats::format(char *buf, int len)
+{
+    int n = snprintf(buf, len, "stats:");
+    for (int i = 0; i < COUNTER_NUM && n < len; ++i)
+        n += snprintf(buf + n, len - n, " %s=%lld", counter_names[i], get((COUNTER)i));
+
+    // 完整响应的命中率，只计可以预先生成完整响应的文件
+    long long hit = get(RESPONSE_CACHE_HIT), total = hit + get(RESPONSE_CACHE_MISS);
+    if (n < len)
+        n += snprintf(buf + n, len - n, " response_cache_hit_ratio=%.3f", total ? (double)hit / total : 0.0);
+
+    // 平均每个请求的系统调用数
+    long long requests = get(REQUEST);
+    if (n < len)
+        n += snprintf(buf + n, len - n, " syscall_per_request=%.2f", requests ? (double)get(SYSCALL) / requests : 0.0);
+
+    for (int i = 0; i < HISTOGRAM_NUM && n < len; ++i)
+        n += snprintf(buf + n, len - n, " %s_p50=%lld %s_p90=%lld %s_p99=%lld",
+                      histogram_names[i], percentile((HISTOGRAM)i, 0.5),
+                      histogram_names[i], percentile((HISTOGRAM)i, 0.9),
+                      histogram_names[i], percentile((HISTOGRAM)i, 0.99));
+    return n < len ? n : len - 1;
+}
@@ -0,0 +1,108 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <time.h>
+
+// 运行统计：各线程用relaxed原子操作累加计数，收到SIGUSR1或退出时输出到终端和日志
+class stats
+{
+public:
+    enum COUNTER
+    {
+        CONN_ACCEPT = 0, // 建立的连接数
+        CONN_CLOSE,      // 关闭的连接数
+        CONN_ALLOC,      // 连接表的slab向系统申请的连接对象数，随同时存在的最大连接数增长
+        CONN_DEFER,      // 关闭时仍有线程在访问、推迟复用的连接对象数
+        SQL_ACQUIRE,     // 从数据库连接池取连接的次数
+        SQL_WAIT_US,     // 等待数据库连接池的累计时间(us)
+        FILE_CACHE_HIT,  // 文件缓存命中次数
+        FILE_CACHE_MISS, // 文件缓存未命中、打开后放入缓存的次数
+        FILE_CACHE_SKIP, // 不能缓存(不存在、不是可读的普通文件或超过大小上限)的文件的查找次数
+        FILE_CACHE_EVICT,// 文件缓存淘汰的文件数
+        FILE_CACHE_STALE,// 磁盘上已改变、移出缓存后重新打开的文件数
+        RESPONSE_CACHE_HIT,   // 直接发送预先生成的完整响应的次数
+        RESPONSE_CACHE_MISS,  // 本可以预先生成完整响应、却需要格式化响应头的文件响应次数
+        RESPONSE_CACHE_SKIP,  // 文件超过大小上限(或缓存未启用)、不预先生成完整响应的文件响应次数
+        RESPONSE_CACHE_BYTES, // 缓存中完整响应占用的字节数
+        REQUEST_PIPELINED,    // 与前一个请求合并在同一批中发送响应的流水线请求数
+        BUFFER_ALLOC,         // 缓冲区池向系统申请的缓冲区数
+        BUFFER_GROW,          // 读缓冲区放不下请求而换用更大规格的次数
+        BUFFER_BYTES,         // 连接当前持有的读写缓冲区总字节数
+        WORK_STEAL,           // 工作线程从其他线程的队列窃取的任务数
+        THREAD_COUNT,         // 线程池当前的工作线程数
+        THREAD_SPAWN,         // 任务排队过久而新增的工作线程数
+        THREAD_RETIRE,        // 空闲过久而退出的工作线程数
+        REQUEST_INLINE,       // 混合模式下在Reactor线程上处理完毕、未交给线程池的批数
+        WORK_STALE,           // 连接在排队期间已关闭而被丢弃的任务数
+        WORK_EXPIRED,         // 排队超过期限而被丢弃的任务数
+        REQUEST,              // 处理的请求数
+        SYSCALL,              // epoll后端连接收发路径上的系统调用数(epoll_wait、epoll_ctl、recv、发送及shutdown)
+        SQL_ASYNC,            // 提交给查询线程非阻塞执行的查询数
+        SQL_PINNED,           // 线程独占模式下直接取用本线程连接的次数(不经过共享池的锁和信号量)
+        SQL_IN_USE,           // 从数据库连接池取出尚未归还的连接数(含线程独占的)
+        SQL_FREE,             // 数据库连接池中空闲的连接数
+        SQL_GROW,             // 等待连接过久而新建的数据库连接数
+        SQL_SHRINK,           // 空闲过久而关闭的数据库连接数
+        SQL_RECONNECT,        // 断开后重新建立的数据库连接数
+        COUNTER_NUM
+    };
+
+    // 分布统计：按2的幂分桶计数，输出时给出分位数(所在桶的上界)
+    enum HISTOGRAM
+    {
+        QUEUE_WAIT_US = 0,    // 任务在工作队列中的等待时间(us)
+        QUEUE_WAIT_DB_US,     // 任务在数据库通道中的等待时间(us)
+        SQL_QUERY_US,         // 非阻塞查询从提交到完成的时间(us)
+        SQL_ACQUIRE_US,       // 从数据库连接池取连接的等待时间(us)
+        HISTOGRAM_NUM
+    };
+
+    static stats *get_instance()
+    {
+        static stats instance;
+        return &instance;
+    }
+
+    void add(COUNTER c, long long n = 1)
+    {
+        m_counters[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    long long get(COUNTER c)
+    {
+        return m_counters[c].load(std::memory_order_relaxed);
+    }
+
+    void observe(HISTOGRAM h, long long v)
+    {
+        int b = 0;
+        while (b < BUCKET_NUM - 1 && (1LL << b) <= v)
+            ++b;
+        m_buckets[h][b].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 分位数p(0~1)所在桶的上界，没有样本时为0
+    long long percentile(HISTOGRAM h, double p);
+
+    // 单调时钟的当前时刻(us)，用于统计耗时
+    static long long now_us()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    // 格式化为一行"name=value ..."，返回写入的长度
+    int format(char *buf, int len);
+
+private:
+    stats();
+
+    static const int BUCKET_NUM = 40;   // 第i个桶统计[2^(i-1), 2^i)，第0个桶统计0
+
+    std::atomic<long long> m_counters[COUNTER_NUM];
+    std::atomic<long long> m_buckets[HISTOGRAM_NUM][BUCKET_NUM];
+};
+
+#endif
@@ -0,0 +1,235 @@
+// 请求解析微基准：原来逐字节的parse_line + strpbrk/strncasecmp 与 向量化扫描 + 按名称长度分派
+// 使用浏览器发出的典型GET请求（约700字节、14个请求头），每次解析前复制到读缓冲区（解析会写入'\0'）
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "../../http/http_scan.h"
+
+static const char *REQUEST =
+    "GET /judge.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8\r\n"
+    "\r\n";
+
+// 带长Cookie的请求，行越长向量化收益越大
+static const char *REQUEST_COOKIE_HEAD =
+    "GET /judge.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: ";
+static char REQUEST_COOKIE[4096];
+
+static const int ITERS  = 50000;
+static const int ROUNDS = 10;
+
+struct result
+{
+    char *url;
+    char *host;
+    bool  linger;
+    long  content_length;
+};
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 原来的实现：逐字节找行尾，再用strpbrk/strspn/strncasecmp重新扫描
+static bool parse_legacy(char *buf, int len, result *r)
+{
+    int checked = 0, start = 0;
+    bool request_line = true;
+    while (checked < len)
+    {
+        for (; checked < len; ++checked)
+        {
+            if (buf[checked] == '\r' && checked + 1 < len && buf[checked + 1] == '\n')
+                break;
+        }
+        if (checked >= len)
+            return false;
+        buf[checked++] = '\0';
+        buf[checked++] = '\0';
+        char *text = buf + start;
+        start = checked;
+
+        if (request_line)
+        {
+            char *url = strpbrk(text, " \t");
+            if (!url)
+                return false;
+            *url++ = '\0';
+            url += strspn(url, " \t");
+            if (strcasecmp(text, "GET") != 0)
+                return false;
+            char *version = strpbrk(url, " \t");
+            if (!version)
+                return false;
+            *version++ = '\0';
+            version += strspn(version, " \t");
+            if (strcasecmp(version, "HTTP/1.1") != 0)
+                return false;
+            r->url = url;
+            request_line = false;
+        }
+        else if (text[0] == '\0')
+            return true;
+        else if (strncasecmp(text, "Connection:", 11) == 0)
+        {
+            text += 11;
+            text += strspn(text, " \t");
+            r->linger = strcasecmp(text, "keep-alive") == 0;
+        }
+        else if (strncasecmp(text, "Content-length:", 15) == 0)
+        {
+            text += 15;
+            text += strspn(text, " \t");
+            r->content_length = atol(text);
+        }
+        else if (strncasecmp(text, "Host:", 5) == 0)
+        {
+            text += 5;
+            text += strspn(text, " \t");
+            r->host = text;
+        }
+    }
+    return false;
+}
+
+// 新的实现：一次扫描得到行尾和第一个分隔符
+template <int (*SCAN)(const char *, int, int, int *)>
+static bool parse_scan(char *buf, int len, result *r)
+{
+    int checked = 0, start = 0;
+    bool request_line = true;
+    while (checked < len)
+    {
+        int sep;
+        checked = SCAN(buf, checked, len, &sep);
+        if (checked + 1 >= len || buf[checked] != '\r' || buf[checked + 1] != '\n')
+            return false;
+        buf[checked++] = '\0';
+        buf[checked++] = '\0';
+        char *text = buf + start;
+        int line_sep = sep < 0 ? -1 : sep - start;
+        start = checked;
+
+        if (request_line)
+        {
+            if (line_sep < 0 || (text[line_sep] != ' ' && text[line_sep] != '\t'))
+                return false;
+            char *url = text + line_sep;
+            *url++ = '\0';
+            url += strspn(url, " \t");
+            if (strcasecmp(text, "GET") != 0)
+                return false;
+            char *version = strpbrk(url, " \t");
+            if (!version)
+                return false;
+            *version++ = '\0';
+            version += strspn(version, " \t");
+            if (strcasecmp(version, "HTTP/1.1") != 0)
+                return false;
+            r->url = url;
+            request_line = false;
+            continue;
+        }
+        if (text[0] == '\0')
+            return true;
+
+        int name_len = (line_sep >= 0 && text[line_sep] == ':') ? line_sep : -1;
+        char *value = text + name_len + 1;
+        value += strspn(value, " \t");
+        if (name_len == 10 && strncasecmp(text, "Connection", 10) == 0)
+            r->linger = strcasecmp(value, "keep-alive") == 0;
+        else if (name_len == 14 && strncasecmp(text, "Content-length", 14) == 0)
+            r->content_length = atol(value);
+        else if (name_len == 4 && strncasecmp(text, "Host", 4) == 0)
+            r->host = value;
+    }
+    return false;
+}
+
+static void bench(const char *name, const char *request, bool (*parse)(char *, int, result *))
+{
+    int len = strlen(request);
+    char buf[4096];
+    result r;
+    memset(&r, 0, sizeof(r));
+
+    // 先确认解析结果正确
+    memcpy(buf, request, len);
+    if (!parse(buf, len, &r) || strcmp(r.url, "/judge.html") || strcmp(r.host, "127.0.0.1:9006") || !r.linger)
+    {
+        printf("%-8s parse error\n", name);
+        exit(1);
+    }
+
+    // 取多轮中的最好成绩，减少调度和频率波动的影响；复制的开销单独测量后扣除
+    double ns = 1e18;
+    volatile char sink = 0;
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        double t0 = now_ns();
+        for (int i = 0; i < ITERS; ++i)
+        {
+            memcpy(buf, request, len);
+            parse(buf, len, &r);
+        }
+        double t1 = now_ns();
+        for (int i = 0; i < ITERS; ++i)
+        {
+            memcpy(buf, request, len);
+            sink = sink + buf[i % len];
+        }
+        double t2 = now_ns();
+        double cur = ((t1 - t0) - (t2 - t1)) / ITERS;
+        if (cur < ns)
+            ns = cur;
+    }
+    printf("%-8s %4d bytes  %7.1f ns/request  %5.2f GB/s\n", name, len, ns, len / ns);
+}
+
+static void bench_all(const char *title, const char *request)
+{
+    printf("%s:\n", title);
+    bench("legacy", request, parse_legacy);
+    bench("scalar", request, parse_scan<http_scan_line_scalar>);
+#ifdef HTTP_SCAN_X86
+    bench("sse2", request, parse_scan<http_scan_line_sse2>);
+    if (__builtin_cpu_supports("avx2"))
+        bench("avx2", request, parse_scan<http_scan_line_avx2>);
+#endif
+}
+
+int main()
+{
+    printf("server uses: %s\n", http_scan_impl());
+    bench_all("browser GET", REQUEST);
+
+    // 约3KB的Cookie
+    int n = snprintf(REQUEST_COOKIE, sizeof(REQUEST_COOKIE), "%s", REQUEST_COOKIE_HEAD);
+    for (int i = 0; n < 3000; ++i)
+        n += snprintf(REQUEST_COOKIE + n, sizeof(REQUEST_COOKIE) - n, "k%d=%08x%08x; ", i, i * 2654435761u, i);
+    snprintf(REQUEST_COOKIE + n, sizeof(REQUEST_COOKIE) - n, "last=1\r\n\r\n");
+    bench_all("long cookie", REQUEST_COOKIE);
+    return 0;
+}
@@ -0,0 +1,197 @@
+// HTTP/1.1流水线压测客户端：每个连接一次写入depth个请求，收齐depth个响应后再发下一批
+// 用法：pipeline_bench [-h 127.0.0.1] [-p 9006] [-c 连接数] [-d 流水线深度] [-t 秒] [-u /picture.html]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+struct client
+{
+    int         fd;
+    int         pending;   // 本批尚未收到的响应数
+    long        body_left; // 当前响应还需跳过的响应体字节数，-1表示正在读响应头
+    std::string header;    // 未读完的响应头
+};
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_to(const char *host, int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// 解析收到的数据，返回本次完整收到的响应数，出错返回-1
+static int consume(client &c, const char *data, int len)
+{
+    int done = 0;
+    while (len > 0)
+    {
+        if (c.body_left >= 0)
+        {
+            long n = len < c.body_left ? len : c.body_left;
+            c.body_left -= n;
+            data += n;
+            len -= n;
+            if (c.body_left == 0)
+            {
+                c.body_left = -1;
+                ++done;
+            }
+            continue;
+        }
+
+        // 逐字节找响应头结尾，响应头很短，不影响压测结果
+        c.header.push_back(*data++);
+        --len;
+        size_t n = c.header.size();
+        if (n < 4 || c.header.compare(n - 4, 4, "\r\n\r\n") != 0)
+            continue;
+        if (c.header.compare(0, 12, "HTTP/1.1 200") != 0)
+            return -1;
+        const char *cl = strcasestr(c.header.c_str(), "Content-Length:");
+        c.body_left = cl ? atol(cl + 15) : 0;
+        c.header.clear();
+        if (c.body_left == 0)
+        {
+            c.body_left = -1;
+            ++done;
+        }
+    }
+    return done;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "127.0.0.1";
+    const char *url = "/picture.html";
+    int port = 9006, conns = 50, depth = 16, seconds = 5;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:d:t:u:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'c': conns = atoi(optarg); break;
+        case 'd': depth = atoi(optarg); break;
+        case 't': seconds = atoi(optarg); break;
+        case 'u': url = optarg; break;
+        default:  return 1;
+        }
+    }
+
+    char one[512];
+    snprintf(one, sizeof(one), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n", url, host);
+    std::string batch;
+    for (int i = 0; i < depth; ++i)
+        batch += one;
+
+    int epfd = epoll_create(conns);
+    std::vector<client> clients(conns);
+    for (int i = 0; i < conns; ++i)
+    {
+        clients[i].fd = connect_to(host, port);
+        if (clients[i].fd < 0)
+        {
+            perror("connect");
+            return 1;
+        }
+        clients[i].pending = 0;
+        clients[i].body_left = -1;
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+
+    long responses = 0, errors = 0;
+    static char buf[1 << 16];
+    double start = now_s(), end = start + seconds;
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        // 一批请求不超过socket发送缓冲区，一次写完
+        send(clients[i].fd, batch.data(), batch.size(), 0);
+        clients[i].pending = depth;
+    }
+
+    epoll_event events[1024];
+    while (now_s() < end)
+    {
+        int n = epoll_wait(epfd, events, 1024, 100);
+        for (int k = 0; k < n; ++k)
+        {
+            client &c = clients[events[k].data.u32];
+            while (true)
+            {
+                int len = recv(c.fd, buf, sizeof(buf), 0);
+                if (len < 0 && errno == EAGAIN)
+                    break;
+                int done = len > 0 ? consume(c, buf, len) : -1;
+                if (done < 0)
+                {
+                    // 连接出错或被关闭，重新建立连接并补发一批
+                    ++errors;
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, 0);
+                    close(c.fd);
+                    c.fd = connect_to(host, port);
+                    if (c.fd < 0)
+                        return 1;
+                    c.header.clear();
+                    c.body_left = -1;
+                    c.pending = 0;
+                    epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.u32 = events[k].data.u32;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+                }
+                else
+                {
+                    responses += done;
+                    c.pending -= done;
+                }
+                if (c.pending == 0)
+                {
+                    send(c.fd, batch.data(), batch.size(), 0);
+                    c.pending = depth;
+                }
+                if (done < 0)
+                    break;
+            }
+        }
+    }
+    double elapsed = now_s() - start;
+
+    printf("depth=%-3d conns=%d  %.0f requests/s  errors=%ld\n", depth, conns, responses / elapsed, errors);
+    return 0;
+}
@@ -0,0 +1,198 @@
+// 工作队列竞争微基准：原来的 std::list + 互斥锁 + 信号量 vs 无锁有界环形队列 mpmc_queue
+// 模拟线程池的使用方式：1个生产者(主线程)不停地分发任务，8/16/32个消费者(工作线程)竞争取出，
+// 统计每秒完成的任务数，以及每千个任务中线程因休眠而让出CPU的次数(自愿上下文切换，即休眠/唤醒的开销)
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <list>
+#include "../../threadpool/mpmc_queue.h"
+
+static const int ITEMS    = 2000000;
+static const int CAPACITY = 10000;     // 与线程池默认的max_requests相同
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 原线程池的工作队列：每次入队加锁、分配链表结点并post，每次出队wait后加锁
+class list_queue
+{
+public:
+    explicit list_queue(int capacity) : m_max(capacity), m_size(0) {}
+
+    bool push(int *item)
+    {
+        m_lock.lock();
+        if (m_size >= m_max)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        m_list.push_back(item);
+        ++m_size;
+        m_lock.unlock();
+        m_stat.post();
+        return true;
+    }
+
+    int *pop()
+    {
+        while (true)
+        {
+            m_stat.wait();
+            m_lock.lock();
+            if (m_list.empty())
+            {
+                m_lock.unlock();
+                continue;
+            }
+            int *item = m_list.front();
+            m_list.pop_front();
+            --m_size;
+            m_lock.unlock();
+            return item;
+        }
+    }
+
+private:
+    int              m_max;
+    int              m_size;
+    std::list<int *> m_list;
+    locker           m_lock;
+    sem              m_stat;
+};
+
+// 线程池的使用方式：只入队不唤醒的mpmc_queue加上共享的idle_waiters，
+// 取不到任务时先自旋再登记休眠，入队后只在确有消费者休眠时才唤醒
+class ring_queue
+{
+public:
+    explicit ring_queue(int capacity) : m_queue(capacity) {}
+
+    bool push(int *item)
+    {
+        if (!m_queue.try_push(item))
+            return false;
+        m_idle.notify();
+        return true;
+    }
+
+    int *pop()
+    {
+        int *item;
+        while (true)
+        {
+            for (int i = 0; i <= m_idle.spin(); ++i)
+            {
+                if (m_queue.try_pop(item))
+                    return item;
+                cpu_relax();
+            }
+
+            m_idle.prepare();
+            if (m_queue.try_pop(item))
+            {
+                m_idle.cancel();
+                return item;
+            }
+            m_idle.wait();
+        }
+    }
+
+private:
+    mpmc_queue<int *> m_queue;
+    idle_waiters      m_idle;
+};
+
+template <typename Q>
+struct context
+{
+    Q                 *queue;
+    std::atomic<long>  done;
+    std::atomic<long>  sum;
+};
+
+template <typename Q>
+static void *consumer(void *arg)
+{
+    context<Q> *ctx = (context<Q> *)arg;
+    long sum = 0, n = 0;
+    while (true)
+    {
+        int *item = ctx->queue->pop();
+        if (!item)
+            break;
+        sum += *item;
+        ++n;
+    }
+    ctx->sum.fetch_add(sum);
+    ctx->done.fetch_add(n);
+    return NULL;
+}
+
+template <typename Q>
+static void bench(const char *name, int consumers, int *items)
+{
+    Q queue(CAPACITY);
+    context<Q> ctx;
+    ctx.queue = &queue;
+    ctx.done = 0;
+    ctx.sum = 0;
+
+    struct rusage ru0, ru1;
+    getrusage(RUSAGE_SELF, &ru0);
+
+    pthread_t *threads = new pthread_t[consumers];
+    for (int i = 0; i < consumers; ++i)
+        pthread_create(&threads[i], NULL, consumer<Q>, &ctx);
+
+    double t0 = now_s();
+    long full = 0;
+    for (int i = 0; i < ITEMS; ++i)
+    {
+        // 队列满时主线程在服务器中会直接丢弃任务，这里让出CPU后重试以保证每个任务都被处理
+        while (!queue.push(&items[i]))
+        {
+            ++full;
+            sched_yield();
+        }
+    }
+    // 每个消费者一个NULL结束标记
+    for (int i = 0; i < consumers; ++i)
+        while (!queue.push(NULL))
+            sched_yield();
+    for (int i = 0; i < consumers; ++i)
+        pthread_join(threads[i], NULL);
+    double t1 = now_s();
+    getrusage(RUSAGE_SELF, &ru1);
+    double switches = (double)(ru1.ru_nvcsw - ru0.ru_nvcsw) * 1000 / ITEMS;
+
+    long expect = (long)ITEMS * (ITEMS - 1) / 2;
+    printf("%-11s consumers=%-3d %8.0f k items/s   %8.1f switches/1k items   queue full %8ld   %s\n",
+           name, consumers, ctx.done.load() / (t1 - t0) / 1000, switches, full,
+           ctx.sum.load() == expect ? "ok" : "LOST ITEMS");
+    delete[] threads;
+}
+
+int main()
+{
+    int *items = new int[ITEMS];
+    for (int i = 0; i < ITEMS; ++i)
+        items[i] = i;
+
+    int consumers[] = { 8, 16, 32 };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench<list_queue>("list+mutex", consumers[i], items);
+        bench<ring_queue>("mpmc_queue", consumers[i], items);
+    }
+    delete[] items;
+    return 0;
+}
@@ -0,0 +1,80 @@
+// 注册语句微基准：文本协议(拼接SQL并转义后mysql_query) vs 连接上预编译的语句(绑定参数后mysql_stmt_execute)
+// 在同一个连接上依次插入n个不同的用户，统计每秒完成的注册数，结束后删除插入的行
+// 用法：sql_bench [-h localhost] [-P 3306] [-u yy] [-w 0] [-d yydb] [-n 5000]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include "../../CGImysql/sql_connection_pool.h"
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 原来的方式：每次拼接一条INSERT，服务器每次重新解析
+static int insert_text(MYSQL *mysql, const char *name, const char *password)
+{
+    char esc_name[2 * 100 + 1], esc_password[2 * 100 + 1], sql[512];
+    mysql_real_escape_string(mysql, esc_name, name, strlen(name));
+    mysql_real_escape_string(mysql, esc_password, password, strlen(password));
+    snprintf(sql, sizeof(sql), "INSERT INTO user(username, passwd) VALUES('%s', '%s')", esc_name, esc_password);
+    return mysql_query(mysql, sql);
+}
+
+static void bench(const char *name, sql_connection_pool *pool, MYSQL *mysql, bool prepared, int n, const char *prefix)
+{
+    int errors = 0;
+    double t0 = now_s();
+    for (int i = 0; i < n; ++i)
+    {
+        char user[100];
+        snprintf(user, sizeof(user), "%s_%c%d", prefix, prepared ? 'p' : 't', i);
+        const char *params[] = { user, "bench" };
+        int ret = prepared ? pool->Execute(mysql, STMT_REGISTER, params, 2) : insert_text(mysql, user, "bench");
+        if (ret)
+            ++errors;
+    }
+    double t1 = now_s();
+    printf("%-9s %8.0f registrations/s   errors=%d\n", name, n / (t1 - t0), errors);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *host = "localhost", *user = "yy", *passwd = "0", *db = "yydb";
+    int port = 3306, n = 5000;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:P:u:w:d:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h': host = optarg; break;
+        case 'P': port = atoi(optarg); break;
+        case 'u': user = optarg; break;
+        case 'w': passwd = optarg; break;
+        case 'd': db = optarg; break;
+        case 'n': n = atoi(optarg); break;
+        default: break;
+        }
+    }
+
+    // 一个连接：两种方式的差别只在于语句的构造和解析，不受连接池等待的影响
+    sql_connection_pool *pool = sql_connection_pool::GetInstance();
+    pool->init(host, user, passwd, db, port, 1, 1);
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, pool);
+
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "bench%d", (int)getpid());
+    bench("text", pool, mysql, false, n, prefix);
+    bench("prepared", pool, mysql, true, n, prefix);
+
+    char sql[128];
+    snprintf(sql, sizeof(sql), "DELETE FROM user WHERE username LIKE '%s\\_%%'", prefix);
+    mysql_query(mysql, sql);
+    return 0;
+}
@@ -0,0 +1,95 @@
+// 定时器容器微基准：升序链表 sort_timer_lst vs 分层时间轮 time_wheel
+// 模拟服务器的使用方式：N个长连接各持有一个定时器，超时时间为 当前时间 + 15s，
+// 分别测量 新连接加入(add)、连接活跃时刷新(adjust)、连接关闭(del) 以及一次tick批量处理N个超时定时器的耗时
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "../../timer/lst_timer.h"
+
+static const int TIMEOUT = 15000; // ms
+static const int OPS     = 10000;
+
+static void noop_cb(client_data *) {}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 与服务器一样使用预先分配的结点，不计入堆分配的开销
+static util_timer *make_timer(util_timer *timer, long long expire)
+{
+    timer->expire = expire;
+    timer->cb_func = noop_cb;
+    timer->user_data = NULL;
+    return timer;
+}
+
+template <typename C>
+static void bench(const char *name, int n)
+{
+    C *c = new C;
+    long long base = get_time_ms();
+    std::vector<util_timer *> timers(n);
+    std::vector<util_timer> nodes(n + OPS);
+
+    // 已有的n个连接，超时时间均匀分布在接下来的一个超时周期内；
+    // 按超时时间从大到小插入，使链表的预热插入也是O(1)，只测量稳态操作
+    for (int i = n - 1; i >= 0; --i)
+    {
+        timers[i] = make_timer(&nodes[i], base + (long long)i * TIMEOUT / n);
+        c->add_timer(timers[i]);
+    }
+
+    // 新连接加入并随即关闭
+    std::vector<util_timer *> extra(OPS);
+    double t0 = now_ns();
+    for (int i = 0; i < OPS; ++i)
+    {
+        extra[i] = make_timer(&nodes[n + i], base + TIMEOUT);
+        c->add_timer(extra[i]);
+    }
+    double t1 = now_ns();
+    for (int i = 0; i < OPS; ++i)
+        c->del_timer(extra[i]);
+    double t2 = now_ns();
+
+    // 随机连接有数据到来，刷新其超时时间
+    srand(1);
+    double t3 = now_ns();
+    for (int i = 0; i < OPS; ++i)
+    {
+        util_timer *timer = timers[rand() % n];
+        timer->expire = base + TIMEOUT;
+        c->adjust_timer(timer);
+    }
+    double t4 = now_ns();
+
+    // 全部超时后一次tick批量处理
+    for (int i = 0; i < n; ++i)
+    {
+        timers[i]->expire = base - 1;
+        c->adjust_timer(timers[i]);
+    }
+    double t5 = now_ns();
+    c->tick();
+    double t6 = now_ns();
+
+    printf("%-15s n=%-7d add %9.1f ns/op   del %7.1f ns/op   adjust %9.1f ns/op   tick %7.1f ns/timer\n",
+           name, n, (t1 - t0) / OPS, (t2 - t1) / OPS, (t4 - t3) / OPS, (t6 - t5) / n);
+    delete c;
+}
+
+int main()
+{
+    int sizes[] = { 1000, 10000, 100000 };
+    for (int i = 0; i < 3; ++i)
+    {
+        bench<sort_timer_lst>("sort_timer_lst", sizes[i]);
+        bench<time_wheel>("time_wheel", sizes[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef MYSQL_STUB_ERRMSG_H
+#define MYSQL_STUB_ERRMSG_H
+
+#define CR_CONN_HOST_ERROR   2003
+#define CR_SERVER_GONE_ERROR 2006
+#define CR_SERVER_LOST       2013
+
+#endif
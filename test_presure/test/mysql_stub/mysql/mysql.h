@@ -0,0 +1,87 @@
+#ifndef MYSQL_STUB_MYSQL_H
+#define MYSQL_STUB_MYSQL_H
+
+// 测试用的MySQL客户端库替身，只声明服务器用到的接口，实现见mysql_stub.cpp
+#include <stddef.h>
+
+typedef char my_bool;
+typedef char **MYSQL_ROW;
+
+// 服务器的连接池把MYSQL对象直接放在连接槽中，必须是完整类型
+typedef struct st_mysql
+{
+    int      fds[2];   // 非阻塞查询完成时由辅助线程写入fds[1]，fds[0]作为连接的socket
+    int      epoch;    // 建立连接时数据库的重启次数，与当前不同时连接已断开
+    unsigned err;      // 最近一次操作的错误码
+    int      owned;    // 由mysql_init(NULL)分配，mysql_close时释放
+} MYSQL;
+
+typedef struct st_mysql_res MYSQL_RES;
+typedef struct st_mysql_field { char *name; } MYSQL_FIELD;
+typedef struct st_mysql_stmt MYSQL_STMT;
+
+enum enum_field_types { MYSQL_TYPE_LONG = 3, MYSQL_TYPE_VAR_STRING = 253, MYSQL_TYPE_STRING = 254 };
+
+typedef struct st_mysql_bind
+{
+    unsigned long         *length;
+    my_bool               *is_null;
+    void                  *buffer;
+    my_bool               *error;
+    enum enum_field_types  buffer_type;
+    unsigned long          buffer_length;
+} MYSQL_BIND;
+
+enum mysql_option
+{
+    MYSQL_OPT_CONNECT_TIMEOUT = 0,
+    MYSQL_OPT_READ_TIMEOUT = 11,
+    MYSQL_OPT_WRITE_TIMEOUT = 12,
+    MYSQL_OPT_NONBLOCK = 6000
+};
+
+#define MYSQL_WAIT_READ    1
+#define MYSQL_WAIT_WRITE   2
+#define MYSQL_WAIT_EXCEPT  4
+#define MYSQL_WAIT_TIMEOUT 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mysql_library_init(int argc, char **argv, char **groups);
+int mysql_thread_init(void);
+void mysql_thread_end(void);
+
+MYSQL *mysql_init(MYSQL *mysql);
+int mysql_options(MYSQL *mysql, enum mysql_option option, const void *arg);
+MYSQL *mysql_real_connect(MYSQL *mysql, const char *host, const char *user, const char *passwd, const char *db,
+                          unsigned int port, const char *unix_socket, unsigned long flags);
+void mysql_close(MYSQL *mysql);
+int mysql_ping(MYSQL *mysql);
+unsigned int mysql_errno(MYSQL *mysql);
+const char *mysql_error(MYSQL *mysql);
+int mysql_get_socket(MYSQL *mysql);
+unsigned int mysql_get_timeout_value_ms(const MYSQL *mysql);
+
+int mysql_query(MYSQL *mysql, const char *q);
+MYSQL_RES *mysql_store_result(MYSQL *mysql);
+unsigned int mysql_num_fields(MYSQL_RES *res);
+MYSQL_FIELD *mysql_fetch_fields(MYSQL_RES *res);
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res);
+
+MYSQL_STMT *mysql_stmt_init(MYSQL *mysql);
+int mysql_stmt_prepare(MYSQL_STMT *stmt, const char *q, unsigned long length);
+my_bool mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bind);
+int mysql_stmt_execute(MYSQL_STMT *stmt);
+int mysql_stmt_execute_start(int *ret, MYSQL_STMT *stmt);
+int mysql_stmt_execute_cont(int *ret, MYSQL_STMT *stmt, int status);
+my_bool mysql_stmt_close(MYSQL_STMT *stmt);
+unsigned int mysql_stmt_errno(MYSQL_STMT *stmt);
+const char *mysql_stmt_error(MYSQL_STMT *stmt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,240 @@
+// 测试用的MySQL客户端库替身：实现服务器用到的接口，user表保存在内存中。
+// 非阻塞查询的socket是一个管道，辅助线程在查询到时后写入一个字节使其可读
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <mysql/mysql.h>
+#include <mysql/errmsg.h>
+#include "mysql_stub.h"
+
+using namespace std;
+
+struct st_mysql_res
+{
+    map<string, string> rows;
+    map<string, string>::iterator it;
+    char *row[2];
+    MYSQL_FIELD fields[2];
+};
+
+struct st_mysql_stmt
+{
+    MYSQL      *conn;
+    MYSQL_BIND *params;
+};
+
+static atomic<int>  g_query_ms(0);
+static atomic<bool> g_down(false);
+static atomic<bool> g_reject(false);
+static atomic<int>  g_epoch(0);
+static atomic<int>  g_connects(0);
+static atomic<int>  g_executed(0);
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static map<string, string> g_users;
+
+void stub_set_query_ms(int ms) { g_query_ms = ms; }
+void stub_set_down(bool down) { g_down = down; }
+void stub_restart() { ++g_epoch; }
+void stub_set_reject(bool reject) { g_reject = reject; }
+int stub_connects() { return g_connects; }
+int stub_executed() { return g_executed; }
+
+bool stub_has_user(const char *name)
+{
+    pthread_mutex_lock(&g_lock);
+    bool found = g_users.count(name) > 0;
+    pthread_mutex_unlock(&g_lock);
+    return found;
+}
+
+// 数据库重启后连接已断开
+static bool lost(MYSQL *mysql)
+{
+    mysql->err = mysql->epoch == g_epoch ? 0 : CR_SERVER_GONE_ERROR;
+    return mysql->err != 0;
+}
+
+static string param(const MYSQL_BIND &bind)
+{
+    return string((const char *)bind.buffer, bind.length ? *bind.length : bind.buffer_length);
+}
+
+// 只支持注册语句，参数依次为用户名和密码
+static int execute(MYSQL_STMT *stmt)
+{
+    if (lost(stmt->conn))
+        return 1;
+    if (g_reject)
+    {
+        stmt->conn->err = 1062;  // ER_DUP_ENTRY
+        return 1;
+    }
+    pthread_mutex_lock(&g_lock);
+    g_users[param(stmt->params[0])] = param(stmt->params[1]);
+    pthread_mutex_unlock(&g_lock);
+    ++g_executed;
+    return 0;
+}
+
+// 查询到时后写入fd(连接管道写端的副本)，连接在此之前关闭也不会写到复用了该fd的其他文件上
+static void *notify_worker(void *arg)
+{
+    int fd = (int)(long)arg;
+    usleep(g_query_ms * 1000);
+    char c = 1;
+    // 管道满时查询线程已有可读事件，写失败无妨
+    if (write(fd, &c, 1) < 0)
+    {
+    }
+    close(fd);
+    return NULL;
+}
+
+extern "C" {
+
+int mysql_library_init(int, char **, char **) { return 0; }
+int mysql_thread_init(void) { return 0; }
+void mysql_thread_end(void) {}
+
+MYSQL *mysql_init(MYSQL *mysql)
+{
+    int owned = mysql == NULL;
+    if (owned)
+        mysql = new MYSQL;
+    mysql->owned = owned;
+    mysql->epoch = -1;
+    mysql->err = 0;
+    if (pipe2(mysql->fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        if (owned)
+            delete mysql;
+        return NULL;
+    }
+    return mysql;
+}
+
+int mysql_options(MYSQL *, enum mysql_option, const void *) { return 0; }
+
+MYSQL *mysql_real_connect(MYSQL *mysql, const char *, const char *, const char *, const char *,
+                          unsigned int, const char *, unsigned long)
+{
+    if (g_down)
+    {
+        mysql->err = CR_CONN_HOST_ERROR;
+        return NULL;
+    }
+    mysql->epoch = g_epoch;
+    mysql->err = 0;
+    ++g_connects;
+    return mysql;
+}
+
+void mysql_close(MYSQL *mysql)
+{
+    if (!mysql)
+        return;
+    close(mysql->fds[0]);
+    close(mysql->fds[1]);
+    mysql->fds[0] = mysql->fds[1] = -1;
+    if (mysql->owned)
+        delete mysql;
+}
+
+int mysql_ping(MYSQL *mysql) { return lost(mysql) ? 1 : 0; }
+unsigned int mysql_errno(MYSQL *mysql) { return mysql->err; }
+const char *mysql_error(MYSQL *mysql) { return mysql->err ? "stub: connection error" : ""; }
+int mysql_get_socket(MYSQL *mysql) { return mysql->fds[0]; }
+unsigned int mysql_get_timeout_value_ms(const MYSQL *) { return 0; }
+
+// 只支持启动时读取user表的查询，结果集在下次查询时释放
+static __thread MYSQL_RES *t_result;
+
+int mysql_query(MYSQL *mysql, const char *)
+{
+    if (lost(mysql))
+        return 1;
+    delete t_result;
+    t_result = new MYSQL_RES;
+    pthread_mutex_lock(&g_lock);
+    t_result->rows = g_users;
+    pthread_mutex_unlock(&g_lock);
+    t_result->it = t_result->rows.begin();
+    return 0;
+}
+
+MYSQL_RES *mysql_store_result(MYSQL *) { return t_result; }
+unsigned int mysql_num_fields(MYSQL_RES *) { return 2; }
+MYSQL_FIELD *mysql_fetch_fields(MYSQL_RES *res) { return res->fields; }
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res)
+{
+    if (res->it == res->rows.end())
+        return NULL;
+    res->row[0] = (char *)res->it->first.c_str();
+    res->row[1] = (char *)res->it->second.c_str();
+    ++res->it;
+    return res->row;
+}
+
+MYSQL_STMT *mysql_stmt_init(MYSQL *mysql)
+{
+    MYSQL_STMT *stmt = new MYSQL_STMT;
+    stmt->conn = mysql;
+    stmt->params = NULL;
+    return stmt;
+}
+
+int mysql_stmt_prepare(MYSQL_STMT *stmt, const char *, unsigned long) { return lost(stmt->conn) ? 1 : 0; }
+
+my_bool mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bind)
+{
+    stmt->params = bind;
+    return 0;
+}
+
+int mysql_stmt_execute(MYSQL_STMT *stmt)
+{
+    if (g_query_ms)
+        usleep(g_query_ms * 1000);
+    return execute(stmt);
+}
+
+int mysql_stmt_execute_start(int *ret, MYSQL_STMT *stmt)
+{
+    pthread_t tid;
+    int fd = -1;
+    if (!g_query_ms || lost(stmt->conn) || (fd = dup(stmt->conn->fds[1])) < 0 ||
+        pthread_create(&tid, NULL, notify_worker, (void *)(long)fd) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        *ret = execute(stmt);
+        return 0;
+    }
+    pthread_detach(tid);
+    return MYSQL_WAIT_READ;
+}
+
+int mysql_stmt_execute_cont(int *ret, MYSQL_STMT *stmt, int)
+{
+    char c;
+    if (read(stmt->conn->fds[0], &c, 1) != 1)
+        return MYSQL_WAIT_READ;
+    *ret = execute(stmt);
+    return 0;
+}
+
+my_bool mysql_stmt_close(MYSQL_STMT *stmt)
+{
+    delete stmt;
+    return 0;
+}
+
+unsigned int mysql_stmt_errno(MYSQL_STMT *stmt) { return stmt->conn->err; }
+const char *mysql_stmt_error(MYSQL_STMT *stmt) { return mysql_error(stmt->conn); }
+
+}
@@ -0,0 +1,21 @@
+#ifndef MYSQL_STUB_H
+#define MYSQL_STUB_H
+
+// 测试控制MySQL客户端库替身的接口。替身把user表保存在内存中，不需要数据库
+
+// 每条语句的执行时间(ms)：阻塞接口睡眠该时间，非阻塞接口由辅助线程在到时后使连接的socket可读
+void stub_set_query_ms(int ms);
+// 数据库不可达：之后建立连接均失败
+void stub_set_down(bool down);
+// 数据库重启：已建立的连接均断开，之后在其上执行语句返回CR_SERVER_GONE_ERROR
+void stub_restart();
+// 语句被数据库拒绝(如用户名重复)：之后执行语句均失败，连接不受影响
+void stub_set_reject(bool reject);
+// 成功建立的连接数
+int stub_connects();
+// 执行完成的语句数
+int stub_executed();
+// user表中是否有该用户
+bool stub_has_user(const char *name);
+
+#endif
@@ -0,0 +1,252 @@
+// 非阻塞查询路径的测试：注册请求在do_request中生成语句后暂停(SQL_QUEUED，DEFERRED_REQUEST)，
+// 处理完毕后提交给查询线程，查询完成时sql_done写回结果，再由resume交还线程池从do_request继续。
+// 连接在查询期间关闭并被新连接复用时，结果和交还的任务都不能落到新连接上。
+// 数据库由test_presure/test/mysql_stub中的替身代替，在项目根目录运行：make test
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <atomic>
+#include <string>
+#include "../../http/http_conn.h"
+#include "../../http/conn_table.h"
+#include "../../threadpool/threadpool.h"
+#include "../../CGImysql/sql_async.h"
+#include "mysql_stub/mysql_stub.h"
+
+static int g_failed = 0;
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+            ++g_failed;                                                     \
+        }                                                                   \
+    } while (0)
+
+static char g_root[] = "./root";
+static int g_epollfd = -1;
+static threadpool<http_conn> *g_pool = NULL;
+static std::atomic<int> g_resumed(0);
+
+// 与WebServer::sql_resume相同：把查询完成的请求按提交时的代数交还线程池
+static void on_resume(http_conn *request, unsigned int generation, void *)
+{
+    ++g_resumed;
+    g_pool->resume(request, generation);
+}
+
+static long long counter(stats::COUNTER c)
+{
+    return stats::get_instance()->get(c);
+}
+
+// 等待条件成立，至多timeout_ms毫秒
+template <typename F>
+static bool wait_until(F cond, int timeout_ms)
+{
+    for (int i = 0; i < timeout_ms; ++i)
+    {
+        if (cond())
+            return true;
+        usleep(1000);
+    }
+    return cond();
+}
+
+// 用socketpair模拟新接受的连接，peer为客户端一端
+static http_conn *open_conn(int &peer)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return NULL;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    conn_slot *c = conn_table::get_instance()->alloc(sv[0]);
+    c->http.init(sv[0], addr, g_epollfd, g_root, 0, 1);
+    peer = sv[1];
+    return &c->http;
+}
+
+// 与定时器回调cb_func相同：先从连接表摘下再关闭fd
+static void close_conn(http_conn *conn, int peer)
+{
+    int fd = conn->get_sockfd();
+    epoll_ctl(g_epollfd, EPOLL_CTL_DEL, fd, 0);
+    conn_table::get_instance()->remove(fd);
+    close(fd);
+    close(peer);
+    http_conn::m_user_count--;
+}
+
+static void send_register(int peer, const char *name)
+{
+    std::string body = std::string("user=") + name + "&password=pw";
+    char req[512];
+    snprintf(req, sizeof(req), "POST /3CGISQL.cgi HTTP/1.1\r\nHost: test\r\nContent-Length: %d\r\n\r\n%s",
+             (int)body.size(), body.c_str());
+    CHECK(write(peer, req, strlen(req)) == (ssize_t)strlen(req));
+}
+
+static std::string recv_response(int peer)
+{
+    char buf[4096];
+    ssize_t n = recv(peer, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+    return n > 0 ? std::string(buf, n) : std::string();
+}
+
+// 查询完成后交还线程池，工作线程从do_request继续并生成注册成功的响应
+static void test_register()
+{
+    printf("register: queued, resumed and answered\n");
+    stub_set_query_ms(20);
+    int peer;
+    http_conn *conn = open_conn(peer);
+    long long requests = counter(stats::REQUEST);
+    int resumed = g_resumed;
+
+    send_register(peer, "async_alice");
+    CHECK(conn->read_once());
+    // 请求暂停，已提交给查询线程
+    CHECK(!conn->process());
+    CHECK(!stub_has_user("async_alice"));
+
+    CHECK(wait_until([&] { return counter(stats::REQUEST) == requests + 1 && !conn->in_use(); }, 2000));
+    CHECK(g_resumed == resumed + 1);
+    CHECK(stub_has_user("async_alice"));
+
+    // 工作线程离开后再关闭，连接对象不进入隔离区
+    conn->write();
+    std::string resp = recv_response(peer);
+    CHECK(resp.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(resp.find("Sign in") != std::string::npos);
+    close_conn(conn, peer);
+}
+
+// 插入被数据库拒绝时返回注册失败页，用户不记入内存中的用户表，之后可以用同一用户名重新注册
+static void test_register_rejected()
+{
+    printf("register rejected: user not recorded\n");
+    stub_set_query_ms(20);
+    stub_set_reject(true);
+    int peer;
+    http_conn *conn = open_conn(peer);
+    long long requests = counter(stats::REQUEST);
+
+    send_register(peer, "async_carol");
+    CHECK(conn->read_once());
+    CHECK(!conn->process());
+    CHECK(wait_until([&] { return counter(stats::REQUEST) == requests + 1 && !conn->in_use(); }, 2000));
+    conn->write();
+    std::string resp = recv_response(peer);
+    CHECK(resp.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    CHECK(resp.find("Sign up") != std::string::npos);
+    close_conn(conn, peer);
+
+    stub_set_reject(false);
+    conn = open_conn(peer);
+    send_register(peer, "async_carol");
+    CHECK(conn->read_once());
+    CHECK(!conn->process());
+    CHECK(wait_until([&] { return counter(stats::REQUEST) == requests + 2 && !conn->in_use(); }, 2000));
+    CHECK(stub_has_user("async_carol"));
+    conn->write();
+    resp = recv_response(peer);
+    CHECK(resp.find("Sign in") != std::string::npos);
+    close_conn(conn, peer);
+}
+
+// 查询期间连接关闭、同一fd上接受了新连接：结果被丢弃，不交还，新连接不受影响。
+// 查询线程仍在使用旧的连接对象，它留在隔离区，查询结束后才被复用
+static void test_close_mid_query()
+{
+    printf("close mid-query: result dropped, reused connection unaffected\n");
+    stub_set_query_ms(100);
+    int peer;
+    http_conn *conn = open_conn(peer);
+    int fd = conn->get_sockfd();
+    long long requests = counter(stats::REQUEST);
+    int resumed = g_resumed;
+    int executed = stub_executed();
+
+    send_register(peer, "async_bob");
+    CHECK(conn->read_once());
+    CHECK(!conn->process());
+
+    close_conn(conn, peer);
+    http_conn *reused = open_conn(peer);
+    CHECK(reused->get_sockfd() == fd);
+    CHECK(reused != conn);
+    CHECK(conn_table::get_instance()->deferred() == 1);
+
+    // 查询照常完成，但不再交还请求
+    CHECK(wait_until([&] { return stub_executed() == executed + 1; }, 2000));
+    usleep(50 * 1000);
+    CHECK(g_resumed == resumed);
+    CHECK(counter(stats::REQUEST) == requests);
+
+    // 新连接上的请求照常处理，不会误用旧连接的查询结果
+    const char *get = "GET /judge.html HTTP/1.1\r\nHost: test\r\n\r\n";
+    CHECK(write(peer, get, strlen(get)) == (ssize_t)strlen(get));
+    CHECK(reused->read_once());
+    CHECK(reused->process());
+    reused->write();
+    std::string resp = recv_response(peer);
+    CHECK(resp.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    close_conn(reused, peer);
+
+    // 查询线程已离开，下一个连接从隔离区取回旧的连接对象
+    http_conn *next = open_conn(peer);
+    CHECK(next == conn);
+    CHECK(conn_table::get_instance()->deferred() == 0);
+    close_conn(next, peer);
+}
+
+// sql_done通过之后、交还之前连接关闭并被复用：交还的任务带着提交时的代数，被工作线程识别为失效
+static void test_resume_after_reuse()
+{
+    printf("resume after reuse: stale work dropped\n");
+    int peer;
+    http_conn *conn = open_conn(peer);
+    unsigned int generation = conn->get_generation();
+    close_conn(conn, peer);
+    http_conn *reused = open_conn(peer);
+    CHECK(reused == conn);
+    CHECK(reused->get_generation() != generation);
+
+    long long requests = counter(stats::REQUEST);
+    long long stale = counter(stats::WORK_STALE);
+    CHECK(g_pool->resume(reused, generation));
+    CHECK(wait_until([&] { return counter(stats::WORK_STALE) == stale + 1; }, 2000));
+    CHECK(counter(stats::REQUEST) == requests);
+    close_conn(reused, peer);
+}
+
+int main()
+{
+    g_epollfd = epoll_create(5);
+    conn_table::get_instance()->init(1024);
+    file_cache::get_instance()->init(0, 0);
+
+    sql_connection_pool *connPool = sql_connection_pool::GetInstance();
+    connPool->init("localhost", "root", "root", "yourdb", 3306, 2, 1);
+    sql_async *sqlAsync = sql_async::GetInstance();
+    sqlAsync->init("localhost", "root", "root", "yourdb", 3306, 2, 1, on_resume, NULL);
+    http_conn::initmysql_result(connPool, 1, sqlAsync);
+    g_pool = new threadpool<http_conn>(0, NULL, 2);
+
+    test_register();
+    test_register_rejected();
+    test_close_mid_query();
+    test_resume_after_reuse();
+
+    // 查询线程会把完成的请求交还线程池，先于线程池停止
+    sqlAsync->stop();
+    delete g_pool;
+    close(g_epollfd);
+
+    printf(g_failed ? "sql_async_test: %d check(s) failed\n" : "sql_async_test: passed\n", g_failed);
+    return g_failed ? 1 : 0;
+}
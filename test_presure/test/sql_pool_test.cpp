@@ -0,0 +1,143 @@
+// 数据库连接池的测试：连接断开后重新连接，等待连接过久时新建连接，空闲过久时关闭超出最少连接数的连接。
+// 数据库由test_presure/test/mysql_stub中的替身代替，在项目根目录运行：make test
+// 空闲连接要超过IDLE_CLOSE_MS(60s)才关闭，完整运行约需一分钟
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../CGImysql/sql_connection_pool.h"
+#include "mysql_stub/mysql_stub.h"
+
+static int g_failed = 0;
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+            ++g_failed;                                                     \
+        }                                                                   \
+    } while (0)
+
+static const int MAX_CONN = 3;
+static const int MIN_CONN = 1;
+
+static long long counter(stats::COUNTER c)
+{
+    return stats::get_instance()->get(c);
+}
+
+// 等待条件成立，至多timeout_ms毫秒
+template <typename F>
+static bool wait_until(F cond, int timeout_ms)
+{
+    for (int i = 0; i < timeout_ms; i += 10)
+    {
+        if (cond())
+            return true;
+        usleep(10 * 1000);
+    }
+    return cond();
+}
+
+static int execute(sql_connection_pool *pool, MYSQL *conn, const char *name)
+{
+    const char *params[] = { name, "pw" };
+    return pool->Execute(conn, STMT_REGISTER, params, 2);
+}
+
+// 数据库重启后，执行语句时在原MYSQL对象上重新连接并重试；数据库不可达时连接保持断开，由维护线程重新连接
+static void test_reconnect(sql_connection_pool *pool)
+{
+    printf("reconnect: on execute and by the maintenance thread\n");
+    MYSQL *conn = pool->GetConnection();
+    CHECK(conn != NULL);
+    CHECK(execute(pool, conn, "pool_a") == 0);
+
+    long long reconnects = counter(stats::SQL_RECONNECT);
+    stub_restart();
+    CHECK(execute(pool, conn, "pool_b") == 0);
+    CHECK(stub_has_user("pool_b"));
+    CHECK(counter(stats::SQL_RECONNECT) == reconnects + 1);
+
+    stub_set_down(true);
+    stub_restart();
+    CHECK(execute(pool, conn, "pool_c") != 0);
+    CHECK(!stub_has_user("pool_c"));
+    pool->ReleaseConnection(conn);
+
+    stub_set_down(false);
+    CHECK(wait_until([&] { return counter(stats::SQL_RECONNECT) == reconnects + 2; }, 3000));
+    conn = pool->GetConnection();
+    CHECK(execute(pool, conn, "pool_d") == 0);
+    pool->ReleaseConnection(conn);
+}
+
+struct holder
+{
+    sql_connection_pool *pool;
+    MYSQL               *conn;
+};
+
+static void *hold_worker(void *arg)
+{
+    holder *h = (holder *)arg;
+    h->conn = h->pool->GetConnection();
+    return NULL;
+}
+
+// 最少连接都被取出后，等待的线程由维护线程新建的连接满足，至多MAX_CONN个；
+// 归还之后空闲超过IDLE_CLOSE_MS的连接被关闭，只保留MIN_CONN个
+static void test_grow_shrink(sql_connection_pool *pool)
+{
+    printf("grow: waiting threads get new connections\n");
+    long long grows = counter(stats::SQL_GROW);
+    MYSQL *conns[MAX_CONN];
+    conns[0] = pool->GetConnection();
+    CHECK(conns[0] != NULL);
+    for (int i = 1; i < MAX_CONN; ++i)
+    {
+        holder h = { pool, NULL };
+        pthread_t tid;
+        CHECK(pthread_create(&tid, NULL, hold_worker, &h) == 0);
+        pthread_join(tid, NULL);
+        conns[i] = h.conn;
+        CHECK(conns[i] != NULL);
+        CHECK(counter(stats::SQL_GROW) == grows + i);
+    }
+    CHECK(counter(stats::SQL_IN_USE) == MAX_CONN);
+    for (int i = 0; i < MAX_CONN; ++i)
+    {
+        CHECK(execute(pool, conns[i], "pool_grow") == 0);
+        pool->ReleaseConnection(conns[i]);
+    }
+    CHECK(pool->GetFreeConn() == MAX_CONN);
+
+    printf("shrink: idle connections above the minimum are closed (about 60s)\n");
+    long long shrinks = counter(stats::SQL_SHRINK);
+    CHECK(wait_until([&] { return counter(stats::SQL_SHRINK) == shrinks + MAX_CONN - MIN_CONN; }, 65000));
+    CHECK(pool->GetFreeConn() == MIN_CONN);
+    CHECK(counter(stats::SQL_FREE) == MIN_CONN);
+
+    // 收缩之后仍能按需新建
+    conns[0] = pool->GetConnection();
+    holder h = { pool, NULL };
+    pthread_t tid;
+    CHECK(pthread_create(&tid, NULL, hold_worker, &h) == 0);
+    pthread_join(tid, NULL);
+    CHECK(h.conn != NULL);
+    pool->ReleaseConnection(h.conn);
+    pool->ReleaseConnection(conns[0]);
+}
+
+int main()
+{
+    sql_connection_pool *pool = sql_connection_pool::GetInstance();
+    pool->init("localhost", "root", "root", "yourdb", 3306, MAX_CONN, 1, MIN_CONN);
+
+    test_reconnect(pool);
+    test_grow_shrink(pool);
+
+    pool->DestroyPool();
+    printf(g_failed ? "sql_pool_test: %d check(s) failed\n" : "sql_pool_test: passed\n", g_failed);
+    return g_failed ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <vector>
+#include <exception>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "../lock/locker.h"
+
+// Reactor模式下工作线程完成一次读/写任务后产生的完成记录
+// 连接可能在任务处理期间被定时器关闭，fd随即被新连接复用，主线程按代数丢弃属于旧连接的记录
+struct completion
+{
+    int          sockfd;
+    unsigned int generation; // 任务所属连接的代数
+    bool         ok;         // 读写任务是否成功，失败时由主线程关闭连接
+};
+
+// 工作线程 -> 主线程的完成队列
+// 工作线程push完成记录并通过eventfd唤醒主线程，主线程在epoll中监听该eventfd并批量取出记录，
+// 主线程分发任务后无需等待工作线程，多个连接的读写任务可以同时进行
+class completion_queue
+{
+public:
+    completion_queue()
+    {
+        m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventfd < 0) {
+            throw std::exception();
+        }
+    }
+    ~completion_queue() { close(m_eventfd); }
+
+    int get_eventfd() const { return m_eventfd; }
+
+    // 工作线程调用：队列由空变为非空时才需要唤醒主线程，其余情况主线程必然还会来取
+    void push(int sockfd, unsigned int generation, bool ok)
+    {
+        completion c;
+        c.sockfd     = sockfd;
+        c.generation = generation;
+        c.ok         = ok;
+
+        m_lock.lock();
+            bool need_wakeup = m_queue.empty();
+            m_queue.push_back(c);
+        m_lock.unlock();
+
+        if (need_wakeup) {
+            uint64_t one = 1;
+            ::write(m_eventfd, &one, sizeof(one));
+        }
+    }
+
+    // 主线程调用：先清空eventfd计数再取走全部记录，保证不会丢失唤醒
+    // out在调用前应为空，与内部队列交换以复用两者的内存
+    void reap(std::vector<completion> &out)
+    {
+        uint64_t cnt;
+        ::read(m_eventfd, &cnt, sizeof(cnt));
+
+        m_lock.lock();
+            out.swap(m_queue);
+        m_lock.unlock();
+    }
+
+private:
+    int                     m_eventfd;
+    locker                  m_lock;
+    std::vector<completion> m_queue;
+};
+
+#endif
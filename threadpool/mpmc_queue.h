@@ -0,0 +1,177 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <exception>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "../lock/locker.h"
+
+// 自旋等待中的一次停顿，把流水线让给同一核上的另一个超线程
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// 空闲消费者的休眠与唤醒，可由多个队列共享（工作窃取时所有工作线程的队列共用一个）。
+// 消费者：prepare登记休眠后必须再检查一次队列，取到任务则cancel，否则wait；
+// 生产者：入队之后notify，只在确有消费者登记休眠时才post。
+// 登记与入队之间各有一次全屏障，要么生产者看到休眠的消费者，要么消费者登记后的检查取到该任务
+class idle_waiters
+{
+public:
+    idle_waiters() : m_idle(0)
+    {
+        // 单核时不自旋，自旋只会占住生产者需要的CPU
+        m_spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_COUNT : 0;
+    }
+
+    // 休眠前的自旋次数
+    int spin() const { return m_spin; }
+    // 已登记休眠的消费者数
+    int idle() const { return m_idle.load(std::memory_order_relaxed); }
+
+    void prepare()
+    {
+        m_idle.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    // 撤销登记；若生产者已取走登记并post，该post由其他休眠者消耗或使之后的一次wait提前返回
+    void cancel() { take_idle(); }
+    void wait() { m_wakeup.wait(); }
+    // 最多休眠ms毫秒，超时返回false，此时登记已撤销
+    bool wait_for(int ms)
+    {
+        if (m_wakeup.timewait(ms))
+            return true;
+        if (take_idle())
+            return false;
+        // 登记已被生产者取走，其post随后必然到达，消耗它以免之后的wait提前返回
+        m_wakeup.wait();
+        return true;
+    }
+
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (take_idle())
+            m_wakeup.post();
+    }
+
+private:
+    static const int SPIN_COUNT = 128;   // 多核时休眠前的自旋次数，约数微秒
+
+    // 取走一个休眠登记，没有休眠的消费者时返回false
+    bool take_idle()
+    {
+        int idle = m_idle.load(std::memory_order_relaxed);
+        while (idle > 0 && !m_idle.compare_exchange_weak(idle, idle - 1, std::memory_order_relaxed))
+            ;
+        return idle > 0;
+    }
+
+    int                             m_spin;
+    alignas(64) std::atomic<int>    m_idle;  // 已登记休眠、尚未被唤醒的消费者数
+    sem                             m_wakeup;
+};
+
+// 有界多生产者多消费者无锁环形队列（每个槽带序号的Vyukov算法）
+// 槽在构造时一次分配，入队出队各是一次CAS，不加锁、不分配内存。
+// 队列本身不等待，消费者的自旋与休眠、生产者的唤醒由共享的idle_waiters负责
+template <typename T>
+class mpmc_queue
+{
+public:
+    // 容量向上取整为2的幂
+    explicit mpmc_queue(int capacity) : m_head(0), m_tail(0)
+    {
+        if (capacity <= 0)
+            throw std::exception();
+        size_t size = 1;
+        while (size < (size_t)capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_cells = new cell[size];
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    ~mpmc_queue() { delete[] m_cells; }
+
+    // 只入队不唤醒，由调用者在共享的idle_waiters上notify；队列已满时返回false
+    bool try_push(T item)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        cell *c;
+        while (true)
+        {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = m_tail.load(std::memory_order_relaxed);
+        }
+        c->data = item;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列为空时返回false，不等待
+    bool try_pop(T &item)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        cell *c;
+        while (true)
+        {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = m_head.load(std::memory_order_relaxed);
+        }
+        item = c->data;
+        c->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 已出队的任务总数和队列中的任务数，并发修改时只是近似值，供线程池监控积压
+    size_t popped() const { return m_head.load(std::memory_order_relaxed); }
+    size_t size() const
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> seq;
+        T                   data;
+    };
+
+    cell*   m_cells;
+    size_t  m_mask;
+
+    // 出队位置和入队位置分别被消费者、生产者频繁修改，各占一个缓存行
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif
@@ -1,12 +1,15 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
 #include <exception>
 #include <pthread.h>
+#include <sched.h>
+#include <vector>
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
+#include "completion_queue.h"
+#include "mpmc_queue.h"
+#include "../stats/stats.h"
 
 
 // 测试
@@ -20,109 +23,472 @@ public:
     };
 
 
-    /*thread_number是线程池中线程的数量，
-    max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int actor_model, sql_connection_pool* connPool,
-               int thread_number = 8, int max_request = 10000);
+    /*thread_number是线程池中常驻线程的数量，
+    max_thread是线程池可扩展到的最大线程数，不大于thread_number时线程数固定，
+    max_requests是请求队列中最多允许的、等待处理的请求的数量，
+    completion是Reactor模式下向主线程汇报读写结果的完成队列，
+    work_steal为1时每个工作线程各有一个队列，空闲时从其他线程的队列窃取任务，
+    db_thread大于0时访问数据库的请求进入单独的数据库通道，最多由db_thread个线程同时处理，
+    其余线程只处理静态请求，数据库变慢时静态请求不会排在数据库请求之后，
+    deadline_ms大于0时任务在队列中等待超过该时间即被丢弃*/
+    threadpool(int actor_model, completion_queue* completion,
+               int thread_number = 8, int work_steal = 0, int max_thread = 0, int db_thread = 0,
+               int deadline_ms = 0, int max_request = 10000);
     ~threadpool();
     bool append(T *request, IOState state);     // Reactor模式的append
     bool append_p(T *request);                  // Proactor模式的append
+    bool resume(T *request, unsigned int generation); // 非阻塞查询完成后交还的请求，不再读，从暂停处继续处理
 
 private:
+    // 任务排队超过该时间且没有空闲线程时新增一个工作线程，两次新增之间也至少间隔该时间
+    static const int SPAWN_WAIT_US  = 10000;
+    // 常驻线程之外的线程空闲超过该时间后退出
+    static const int RETIRE_IDLE_MS = 30000;
+
+    // 工作队列中的任务：连接及其入队时刻，工作线程据此统计排队时间。
+    // 连接在排队期间可能被定时器关闭，甚至其对象已属于新连接，工作线程按入队时的连接代数识别
+    struct work
+    {
+        T*           request;
+        long long    enqueue_us;
+        long long    deadline_us; // 超过该时刻仍未被取出则丢弃，0为不限
+        unsigned int generation;  // 入队时的连接代数
+        bool         db;          // 是否在数据库通道中
+        bool         read_done;   // Reactor模式下已由工作线程读入、转入数据库通道的任务，不再读
+    };
+
+    // 线程槽的状态：下标小于m_min_threads的是常驻线程
+    enum SLOT { SLOT_FREE = 0, SLOT_RUNNING, SLOT_EXITED };
+
+    struct start_arg
+    {
+        threadpool* pool;
+        int         index;
+    };
+
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void* worker(void *arg);
     void run();
+    void stop();
+    // 监控线程：所有线程都阻塞时没有线程再取出任务，由它发现积压并扩容
+    static void* monitor_worker(void *arg);
+    void monitor();
+    // 各队列已出队的任务总数
+    size_t popped();
+    // 有任务在排队，且没有休眠的线程能处理它
+    bool backlog();
+
+    // 在第index个槽上启动工作线程，调用者持有m_thread_lock
+    bool start(int index);
+    // 回收已退出线程的槽，调用者持有m_thread_lock
+    void reap();
+    // 任务排队过久时扩容
+    void maybe_spawn(long long wait_us, long long now);
+    // 本线程空闲过久，允许退出时返回true
+    bool retire();
+
+    // 把任务放入工作队列(db为true时放入数据库通道)并唤醒休眠的工作线程，队列满时返回false
+    // generation为任务所属连接的代数，由调用者在确认连接有效时取得；
+    // deadline_us为0时从现在起算期限，转入数据库通道的任务沿用原来的期限
+    bool push(T *request, unsigned int generation, bool db, bool read_done = false, long long deadline_us = 0);
+    // 任务所属的连接已关闭或任务已过期时返回true，由调用者丢弃
+    bool stale(const work &w, long long now);
+    // 任务处理完毕或被丢弃
+    void finish(const work &w);
+    // 取出任务，队列为空时先自旋再休眠；休眠超过idle_ms(<0为不限)仍没有任务时返回false
+    bool take(work &w, int idle_ms);
+    // 先找静态请求：共享队列模式只检查共享队列，工作窃取模式依次检查本线程队列、共享队列和其他线程的队列；
+    // 都没有时再找数据库通道的任务
+    bool find_work(work &w);
+    // 处理数据库通道任务的线程数未达上限时才从数据库通道取任务
+    bool take_db(work &w);
+
+    // 当前线程若是某个线程池的工作线程，记录所属的线程池及其槽下标
+    static thread_local threadpool* t_pool;
+    static thread_local int         t_index;
 
 private:
     int                  m_actor_model;   // 模型切换（reactor/proactor）
-    sql_connection_pool* m_sqlConnPool;      // 数据库
+    completion_queue*    m_completion;    // Reactor模式的完成队列
 
     // 线程池相关
-    pthread_t*           m_threads;       // 描述线程池的数组，其大小为m_thread_number
-    int                  m_thread_number; // 线程池中的线程数
+    int                    m_min_threads;  // 常驻线程数
+    int                    m_max_threads;  // 最大线程数
+    std::vector<pthread_t> m_threads;      // 各槽上的线程，大小为m_max_threads
+    std::vector<int>       m_slots;        // 各槽的状态
+    int                    m_live;         // 正在运行的线程数
+    bool                   m_stopping;     // 正在析构，不再新增或退出线程
+    locker                 m_thread_lock;  // 保护以上线程槽相关的成员，只在线程增减时使用
+    std::atomic<long long> m_last_spawn_us;
+    pthread_t              m_monitor;      // 监控线程，线程数可扩展时才创建
+    bool                   m_monitoring;
+    sem                    m_monitor_stop; // 通知监控线程退出
 
     // 工作队列相关
-    std::list<T*>        m_workqueue;     // 工作队列（存放待处理的客户连接）
     int                  m_max_requests;  // 工作队列中允许的最大连接数
-    locker               m_queuelocker;   // 保护请求队列的互斥锁
-    sem                  m_queuestat;     // 消费者等待生产者的
+    mpmc_queue<work>     m_workqueue;     // 工作队列（存放待处理的客户连接），无锁有界
+    idle_waiters         m_idle;          // 所有工作线程共用的休眠与唤醒
+
+    // 工作窃取相关
+    int                          m_work_steal;  // 是否使用每线程队列
+    std::vector<mpmc_queue<work>*> m_local;     // 各槽的队列，m_workqueue作为它们满时的共享队列
+
+    // 数据库通道相关
+    int                  m_db_limit;      // 最多同时处理数据库通道任务的线程数
+    mpmc_queue<work>*    m_dbqueue;       // 数据库通道，NULL为不分通道
+    std::atomic<int>     m_db_busy;       // 正在处理数据库通道任务的线程数
+
+    long long            m_deadline_us;   // 任务在队列中的最长等待时间，0为不限
 };
 
 template <typename T>
-threadpool<T>::threadpool( int actor_model, sql_connection_pool *connPool, int thread_number, int max_requests)
-    : m_actor_model(actor_model),m_thread_number(thread_number),
-    m_max_requests(max_requests), m_sqlConnPool(connPool), m_threads(NULL)
+thread_local threadpool<T>* threadpool<T>::t_pool = NULL;
+template <typename T>
+thread_local int threadpool<T>::t_index = -1;
+
+template <typename T>
+threadpool<T>::threadpool( int actor_model, completion_queue *completion,
+                           int thread_number, int work_steal, int max_thread, int db_thread, int deadline_ms,
+                           int max_requests)
+    : m_actor_model(actor_model), m_completion(completion),
+    m_min_threads(thread_number), m_max_threads(max_thread > thread_number ? max_thread : thread_number),
+    m_live(0), m_stopping(false), m_last_spawn_us(0), m_monitoring(false),
+    m_max_requests(max_requests), m_workqueue(max_requests), m_work_steal(work_steal),
+    m_db_limit(db_thread), m_dbqueue(NULL), m_db_busy(0), m_deadline_us(deadline_ms > 0 ? deadline_ms * 1000LL : 0)
 {
-    if (thread_number <= 0 || max_requests <= 0)
+    if (thread_number <= 0)
         throw std::exception();
 
-    m_threads = new pthread_t[m_thread_number];
-    if (!m_threads)
+    // 至少为静态请求保留一个常驻线程
+    if (m_db_limit >= thread_number)
+        m_db_limit = thread_number - 1;
+    if (m_db_limit > 0)
+        m_dbqueue = new mpmc_queue<work>(max_requests);
+
+    m_threads.resize(m_max_threads);
+    m_slots.resize(m_max_threads, SLOT_FREE);
+
+    // 每个常驻线程的队列分摊总容量，某个队列满时放入共享队列；扩容的线程也有自己的队列，但主要靠窃取取得任务
+    if (m_work_steal)
+        for (int i = 0; i < m_max_threads; ++i)
+            m_local.push_back(new mpmc_queue<work>(max_requests / thread_number + 1));
+
+    //! 创建thread_number个常驻线程，析构时通过结束标记通知它们退出并等待
+    m_thread_lock.lock();
+    bool ok = true;
+    for (int i = 0; i < thread_number && ok; ++i)
+        ok = start(i);
+    m_thread_lock.unlock();
+    if (ok && m_max_threads > m_min_threads)
+        ok = m_monitoring = pthread_create(&m_monitor, NULL, monitor_worker, this) == 0;
+    if (!ok) {
+        stop();
         throw std::exception();
+    }
+}
+
+template <typename T>
+threadpool<T>::~threadpool()
+{
+    stop();
+}
+
+// 工作线程在队列为空时会自旋访问队列，必须在线程全部退出后才能释放队列：
+// 先禁止线程增减，再给每个运行中的线程一个NULL结束标记，线程处理完之前的任务、取到标记后退出
+template <typename T>
+void threadpool<T>::stop()
+{
+    m_thread_lock.lock();
+    m_stopping = true;
+    int live = m_live;
+    m_thread_lock.unlock();
+
+    if (m_monitoring)
+    {
+        m_monitor_stop.post();
+        pthread_join(m_monitor, NULL);
+        m_monitoring = false;
+    }
+    for (int i = 0; i < live; ++i)
+        while (!push(NULL, 0, false))
+            sched_yield();
+    for (int i = 0; i < m_max_threads; ++i)
+    {
+        if (m_slots[i] != SLOT_FREE)
+            pthread_join(m_threads[i], NULL);
+        m_slots[i] = SLOT_FREE;
+    }
+    for (size_t i = 0; i < m_local.size(); ++i)
+        delete m_local[i];
+    m_local.clear();
+    delete m_dbqueue;
+    m_dbqueue = NULL;
+}
 
-    //! 创建thread_number个线程，并将它们都设置为脱离线程
-    for (int i = 0; i < thread_number; ++i)
+template <typename T>
+bool threadpool<T>::start(int index)
+{
+    start_arg *arg = new start_arg;
+    arg->pool = this;
+    arg->index = index;
+    if (pthread_create(&m_threads[index], NULL, worker, arg) != 0)
     {
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0) {
-            delete[] m_threads;
-            throw std::exception();
+        delete arg;
+        return false;
+    }
+    m_slots[index] = SLOT_RUNNING;
+    ++m_live;
+    stats::get_instance()->add(stats::THREAD_COUNT);
+    return true;
+}
+
+template <typename T>
+void threadpool<T>::reap()
+{
+    for (int i = m_min_threads; i < m_max_threads; ++i)
+    {
+        if (m_slots[i] == SLOT_EXITED)
+        {
+            pthread_join(m_threads[i], NULL);
+            m_slots[i] = SLOT_FREE;
         }
-        if (pthread_detach(m_threads[i])) {
-            delete[] m_threads;
-            throw std::exception();
+    }
+}
+
+// 工作线程在取到排队过久的任务时、监控线程发现积压的任务一直没有被取走时调用：
+// 数据库查询等阻塞调用占住了所有线程，新增一个线程处理积压的任务；扩容不占用主线程
+template <typename T>
+void threadpool<T>::maybe_spawn(long long wait_us, long long now)
+{
+    if (wait_us < SPAWN_WAIT_US || m_idle.idle() > 0)
+        return;
+    long long last = m_last_spawn_us.load(std::memory_order_relaxed);
+    if (now - last < SPAWN_WAIT_US || !m_last_spawn_us.compare_exchange_strong(last, now))
+        return;
+
+    m_thread_lock.lock();
+    reap();
+    if (!m_stopping && m_live < m_max_threads)
+    {
+        for (int i = m_min_threads; i < m_max_threads; ++i)
+        {
+            if (m_slots[i] == SLOT_FREE)
+            {
+                if (start(i))
+                    stats::get_instance()->add(stats::THREAD_SPAWN);
+                break;
+            }
         }
     }
+    m_thread_lock.unlock();
 }
 
 template <typename T>
-threadpool<T>::~threadpool()
+void *threadpool<T>::monitor_worker(void *arg)
+{
+    ((threadpool *)arg)->monitor();
+    return NULL;
+}
+
+// 每SPAWN_WAIT_US检查一次：有任务排队、没有休眠的线程，且一个周期内没有任何任务被取出，
+// 说明所有线程都被阻塞。线程仍在取任务时由取到任务的线程按排队时间判断
+template <typename T>
+void threadpool<T>::monitor()
 {
-    delete[] m_threads;
+    size_t last = popped();
+    while (!m_monitor_stop.timewait(SPAWN_WAIT_US / 1000))
+    {
+        size_t cur = popped();
+        if (cur == last && backlog())
+            maybe_spawn(SPAWN_WAIT_US, stats::now_us());
+        last = cur;
+    }
+}
+
+template <typename T>
+size_t threadpool<T>::popped()
+{
+    size_t n = m_workqueue.popped();
+    for (size_t i = 0; i < m_local.size(); ++i)
+        n += m_local[i]->popped();
+    if (m_dbqueue)
+        n += m_dbqueue->popped();
+    return n;
+}
+
+// 数据库通道的处理线程数已达上限时，通道中的排队不算积压，扩容也无济于事
+template <typename T>
+bool threadpool<T>::backlog()
+{
+    if (m_idle.idle() > 0)
+        return false;
+    if (m_workqueue.size() > 0)
+        return true;
+    for (size_t i = 0; i < m_local.size(); ++i)
+        if (m_local[i]->size() > 0)
+            return true;
+    return m_dbqueue && m_dbqueue->size() > 0 && m_db_busy.load(std::memory_order_relaxed) < m_db_limit;
+}
+
+template <typename T>
+bool threadpool<T>::retire()
+{
+    m_thread_lock.lock();
+    bool ok = !m_stopping;
+    if (ok)
+    {
+        // 由下一次扩容或析构回收该槽
+        m_slots[t_index] = SLOT_EXITED;
+        --m_live;
+    }
+    m_thread_lock.unlock();
+    if (ok)
+    {
+        stats::get_instance()->add(stats::THREAD_RETIRE);
+        stats::get_instance()->add(stats::THREAD_COUNT, -1);
+    }
+    return ok;
 }
 
 template <typename T>
 bool threadpool<T>::append(T *request, IOState state)
 {
-    //! 操作工作队列需加锁，因为它被所有线程共享
-    m_queuelocker.lock();
-        // 将新工作加入工作队列
-        if (m_workqueue.size() >= m_max_requests)
-        {
-            m_queuelocker.unlock();
+    //! 先设置读写状态再入队，入队即发布给工作线程
+    request->m_state = state;
+    // 将新工作加入工作队列，队列满时失败；有工作线程休眠时才唤醒。
+    // 此时请求尚未读入，由工作线程读入后再决定是否转入数据库通道
+    return push(request, request->get_generation(), false);
+}
+
+template <typename T>
+bool threadpool<T>::append_p(T *request)
+{
+    // 请求已由主线程读入，按请求方法分通道
+    return push(request, request->get_generation(), m_dbqueue && request->is_db_request());
+}
+
+template <typename T>
+bool threadpool<T>::resume(T *request, unsigned int generation)
+{
+    // Reactor模式下按已读入的读任务处理，直接调用process；查询不阻塞工作线程，不进入数据库通道。
+    // 代数用提交查询时的值：交还之前连接可能已关闭并被新连接复用，此时再读取的代数属于新连接
+    request->m_state = IOState::READ;
+    return push(request, generation, false, true);
+}
+
+// 工作窃取模式下，工作线程产生的任务放入自己的队列；
+// 其他线程(主Reactor、从Reactor)产生的任务放入该连接固定对应的常驻线程的队列，
+// 同一连接的请求大多由同一个线程处理，其http_conn留在该线程所在核的缓存中
+template <typename T>
+bool threadpool<T>::push(T *request, unsigned int generation, bool db, bool read_done, long long deadline_us)
+{
+    work w;
+    w.request = request;
+    w.enqueue_us = stats::now_us();
+    w.deadline_us = deadline_us;
+    if (!deadline_us && m_deadline_us)
+        w.deadline_us = w.enqueue_us + m_deadline_us;
+    w.generation = generation;
+    w.db = db;
+    w.read_done = read_done;
+
+    bool ok = false;
+    if (db)
+    {
+        if (!m_dbqueue->try_push(w))
             return false;
-        }
-        request->m_state = state;
-        m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post(); // 有新的工作加入工作队列，通知消费者
+        ok = true;
+    }
+    else if (m_work_steal && request)
+    {
+        int index = t_pool == this ? t_index : (unsigned)request->get_sockfd() % m_min_threads;
+        ok = m_local[index]->try_push(w);
+    }
+    if (!ok && !m_workqueue.try_push(w))
+        return false;
+    m_idle.notify();
     return true;
 }
 
 template <typename T>
-bool threadpool<T>::append_p(T *request)
+bool threadpool<T>::find_work(work &w)
 {
-    m_queuelocker.lock();
-        // 将新工作加入工作队列
-        if (m_workqueue.size() >= m_max_requests)
+    if (!m_work_steal)
+    {
+        if (m_workqueue.try_pop(w))
+            return true;
+    }
+    else
+    {
+        if (m_local[t_index]->try_pop(w) || m_workqueue.try_pop(w))
+            return true;
+        for (int i = 1; i < m_max_threads; ++i)
         {
-            m_queuelocker.unlock();
+            if (m_local[(t_index + i) % m_max_threads]->try_pop(w))
+            {
+                stats::get_instance()->add(stats::WORK_STEAL);
+                return true;
+            }
+        }
+    }
+    return m_dbqueue && take_db(w);
+}
+
+template <typename T>
+bool threadpool<T>::take_db(work &w)
+{
+    int busy = m_db_busy.load(std::memory_order_relaxed);
+    do
+    {
+        if (busy >= m_db_limit)
             return false;
+    } while (!m_db_busy.compare_exchange_weak(busy, busy + 1));
+
+    if (m_dbqueue->try_pop(w))
+        return true;
+    m_db_busy.fetch_sub(1);
+    return false;
+}
+
+template <typename T>
+bool threadpool<T>::take(work &w, int idle_ms)
+{
+    while (true)
+    {
+        for (int i = 0; i <= m_idle.spin(); ++i)
+        {
+            if (find_work(w))
+                return true;
+            cpu_relax();
         }
-        m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
-    return true;
+
+        // 先登记为休眠再找一次，登记之前入队的任务在这里取到，之后入队的任务由生产者唤醒
+        m_idle.prepare();
+        if (find_work(w))
+        {
+            m_idle.cancel();
+            return true;
+        }
+        if (idle_ms < 0)
+            m_idle.wait();
+        else if (!m_idle.wait_for(idle_ms))
+            return false;
+    }
 }
 
 //! C++中使用pthread_create函数时，第三个参数必须是一个static函数
 //! 而在static函数调用non-static函数有两个办法：
 //!     1、在单例模式中，使用类成员中的实例成员来访问non-static成员函数
 //!     2、将当前对象this传递给static函数，然后在static函数中使用这个this指针来访问non-static成员函数
-//!     而这里是使用第二种，使用pthread_create函数时，传递static函数worker，其参数为this指针，worker内部调用non-static函数run
+//!     而这里是使用第二种，使用pthread_create函数时，传递static函数worker，其参数为this指针和线程槽下标，worker内部调用non-static函数run
 template <typename T>
 void *threadpool<T>::worker(void *arg)
 {
-    threadpool *pool = (threadpool *)arg;
+    start_arg *start = (start_arg *)arg;
+    threadpool *pool = start->pool;
+    t_pool = pool;
+    t_index = start->index;
+    delete start;
     pool->run();
     return pool;
 }
@@ -131,62 +497,117 @@ void *threadpool<T>::worker(void *arg)
 template <typename T>
 void threadpool<T>::run()
 {
+    // 只有扩容出来的线程会因空闲而退出
+    int idle_ms = t_index >= m_min_threads ? RETIRE_IDLE_MS : -1;
     while (true)
     {
-        // 工作队列为空时，线程等待队列加入新的连接
-        m_queuestat.wait();   // 等待生产者(append函数)将待处理的连接加入工作队列
-
-        // 线程获取互斥锁，获取队首的待处理的连接，处理该连接的工作
-        m_queuelocker.lock(); // 工作队列被多个线程共享，故加锁
-            if (m_workqueue.empty()) {
-                m_queuelocker.unlock();
-                continue;
-            }
-        	// 线程取出工作队列队首的待处理连接
-            T *request = m_workqueue.front();
-            m_workqueue.pop_front();
-        m_queuelocker.unlock();
+        // 取出工作队列队首的待处理连接；队列为空时先自旋，再休眠等待生产者(append函数)唤醒
+        work w;
+        if (!take(w, idle_ms))
+        {
+            if (retire())
+                return;
+            continue;
+        }
+        T *request = w.request;
+        // 结束标记
         if (!request)
+        {
+            stats::get_instance()->add(stats::THREAD_COUNT, -1);
+            return;
+        }
+
+        long long now = stats::now_us();
+        stats::get_instance()->observe(w.db ? stats::QUEUE_WAIT_DB_US : stats::QUEUE_WAIT_US, now - w.enqueue_us);
+
+        // 已没有人等待结果的任务不碰socket，直接丢弃，连接由其定时器关闭；
+        // 未失效时本线程已登记为连接对象的使用者，处理完毕后leave，此前连接即使关闭，对象也不会被复用
+        if (stale(w, now))
+        {
+            finish(w);
             continue;
+        }
+        // 数据库通道的处理线程数已达上限时，排队是上限造成的，扩容也无济于事
+        if (m_max_threads > m_min_threads && (!w.db || m_db_busy.load(std::memory_order_relaxed) < m_db_limit))
+            maybe_spawn(now - w.enqueue_us, now);
 
         // Reactor
         if (1 == m_actor_model)
         {
+            // 先记下fd，处理过程中连接可能被关闭
+            int sockfd = request->get_sockfd();
+            bool ok = true;
             // 读
             if (0 == request->m_state)
             {
-                if (request->read_once())
+                if (!w.read_done && !request->read_once())
                 {
-                    request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_sqlConnPool);
-                    request->process();
+                    ok = false;
+                }
+                // 读入后才知道请求方法：访问数据库的请求转入数据库通道，读结果由处理它的线程汇报
+                else if (m_dbqueue && !w.db && request->is_db_request() && push(request, w.generation, true, true, w.deadline_us))
+                {
+                    request->leave();
+                    continue;
                 }
                 else
                 {
-                    request->improv = 1;
-                    request->timer_flag = 1;
+                    request->process();
                 }
             }
             // 写
             else
             {
-                if (request->write())
-                {
-                    request->improv = 1;
-                }
-                else
-                {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                ok = request->write();
+                // 本批响应发送完毕后读缓冲区中还有流水线请求，直接在本线程继续处理
+                if (ok && request->has_pending_request())
+                    request->process();
             }
+            request->leave();
+            // 将读写结果交给主线程，失败时由主线程关闭连接、删除定时器
+            m_completion->push(sockfd, w.generation, ok);
         }
         // Proactor
         else
         {
-            connectionRAII mysqlcon(&request->mysql, m_sqlConnPool);
-            request->process();
+            // io_uring后端由事件循环提交send/recv，处理完毕后通知事件循环；
+            // 请求暂停等待查询时连接已交给查询线程，由恢复处理它的线程通知
+            if (request->process() && m_completion)
+                m_completion->push(request->get_sockfd(), w.generation, true);
+            request->leave();
         }
+        finish(w);
+    }
+}
+
+// 连接在排队期间被定时器关闭后代数会改变(见conn_table::remove)，其fd可能已属于新连接；
+// 超过期限的任务，客户端多半已经放弃，处理它只会占用工作线程和数据库连接。
+// 返回false时本线程已登记为连接对象的使用者(见http_conn::enter)
+template <typename T>
+bool threadpool<T>::stale(const work &w, long long now)
+{
+    if (!w.request->enter(w.generation))
+    {
+        stats::get_instance()->add(stats::WORK_STALE);
+        return true;
+    }
+    if (w.deadline_us && now > w.deadline_us)
+    {
+        w.request->leave();
+        stats::get_instance()->add(stats::WORK_EXPIRED);
+        return true;
+    }
+    return false;
+}
+
+// 让出数据库通道的名额；通道中若有因名额已满而未被取走的任务，唤醒休眠的线程处理
+template <typename T>
+void threadpool<T>::finish(const work &w)
+{
+    if (w.db)
+    {
+        m_db_busy.fetch_sub(1);
+        m_idle.notify();
     }
 }
 #endif
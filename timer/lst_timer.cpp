@@ -1,5 +1,13 @@
 #include "lst_timer.h"
 #include "../http/http_conn.h"
+#include "../http/conn_table.h"
+
+long long get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 /*-------------------------------------- class sort_timer_lst ------------------------------------ */
 
@@ -10,13 +18,6 @@ sort_timer_lst::sort_timer_lst()
 }
 sort_timer_lst::~sort_timer_lst()
 {
-    util_timer *tmp = head;
-    while (tmp)
-    {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
-    }
 }
 
 // 插入一个定时器结点到链表中（并保持链表的升序）
@@ -26,6 +27,8 @@ void sort_timer_lst::add_timer(util_timer *timer)
     {
         return;
     }
+    timer->prev = NULL;
+    timer->next = NULL;
     if (!head)
     {
         head = tail = timer;
@@ -74,7 +77,6 @@ void sort_timer_lst::del_timer(util_timer *timer)
     if (timer) {
         if ((timer == head) && (timer == tail))
         {
-            delete timer;
             head = NULL;
             tail = NULL;
             return;
@@ -83,23 +85,24 @@ void sort_timer_lst::del_timer(util_timer *timer)
         {
             head = head->next;
             head->prev = NULL;
-            delete timer;
+            timer->next = NULL;
             return;
         }
         if (timer == tail)
         {
             tail = tail->prev;
             tail->next = NULL;
-            delete timer;
+            timer->prev = NULL;
             return;
         }
         timer->prev->next = timer->next;
         timer->next->prev = timer->prev;
-        delete timer;
+        timer->prev = NULL;
+        timer->next = NULL;
     }
 }
 
-// 核心函数，每次SIGALRM信号到来，便执行一次该函数
+// 核心函数，每次定时器到期，便执行一次该函数
 // 该函数执行链表中超时时间已到的任务
 void sort_timer_lst::tick()
 {
@@ -108,19 +111,19 @@ void sort_timer_lst::tick()
         return;
     }
 
-    time_t cur = time(NULL);
-    util_timer *tmp = head;
-    // 从链表头开始执行超时任务，执行完该任务之后便将其结点从链表中删除
+    long long cur = get_time_ms();
+    // 从链表头开始执行超时任务，先将结点从链表中摘下再执行该任务
     for(util_timer* tmp = head; tmp && tmp->expire <= cur ;tmp = head)
     {
-        // 执行超时任务
-        tmp->cb_func( tmp->user_data );
-
-        // 执行之后将该结点删除
         head = tmp->next;
         if( head )
             head->prev = NULL;
-        delete tmp;
+        else
+            tail = NULL;
+        tmp->next = NULL;
+
+        // 执行超时任务
+        tmp->cb_func( tmp->user_data );
     }
 }
 
@@ -152,10 +155,213 @@ void sort_timer_lst::__add_timer(util_timer *timer, util_timer *lst_head)
 }
 
 
+/*-------------------------------------- class time_wheel ------------------------------------ */
+
+time_wheel::time_wheel()
+{
+    for (int i = 0; i < TVR_SIZE; ++i)
+        list_init(&m_tv1[i]);
+    for (int l = 0; l < TVN_NUM; ++l)
+        for (int i = 0; i < TVN_SIZE; ++i)
+            list_init(&m_tvn[l][i]);
+    m_cur = get_time_ms();
+    m_count = 0;
+}
+
+time_wheel::~time_wheel()
+{
+}
+
+void time_wheel::list_init(util_timer *head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+// 插入到槽链表尾部
+void time_wheel::list_add(util_timer *head, util_timer *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+// 从所在槽中摘除，不需要知道属于哪个槽
+void time_wheel::list_del(util_timer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+// 根据距离当前时刻的远近选择层和槽
+void time_wheel::__add_timer(util_timer *timer)
+{
+    long long expire = timer->expire;
+    long long idx = expire - m_cur;
+    util_timer *head;
+
+    if (idx < 0)
+    {
+        // 已经超时的定时器放到下一个要处理的槽，下次tick立即执行
+        head = &m_tv1[m_cur & TVR_MASK];
+    }
+    else if (idx < TVR_SIZE)
+    {
+        head = &m_tv1[expire & TVR_MASK];
+    }
+    else
+    {
+        int l = 0;
+        while (l < TVN_NUM - 1 && idx >= (1LL << (TVR_BITS + (l + 1) * TVN_BITS)))
+            ++l;
+        // 超出时间轮表示范围的定时器放在最高层最远的槽
+        if (idx >= (1LL << (TVR_BITS + TVN_NUM * TVN_BITS)))
+            expire = m_cur + (1LL << (TVR_BITS + TVN_NUM * TVN_BITS)) - 1;
+        head = &m_tvn[l][(expire >> (TVR_BITS + l * TVN_BITS)) & TVN_MASK];
+    }
+    list_add(head, timer);
+}
+
+// 将第level层第index个槽中的定时器重新分配到下层，返回index
+int time_wheel::cascade(int level, int index)
+{
+    util_timer *head = &m_tvn[level][index];
+    util_timer *tmp = head->next;
+    list_init(head);
+    while (tmp != head)
+    {
+        util_timer *next = tmp->next;
+        __add_timer(tmp);
+        tmp = next;
+    }
+    return index;
+}
+
+void time_wheel::add_timer(util_timer *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    // 时间轮为空时直接把当前时刻拨到现在，避免长时间空闲后tick逐毫秒追赶
+    if (!m_count)
+        m_cur = get_time_ms();
+    ++m_count;
+    __add_timer(timer);
+}
+
+// 超时时间改变后从原槽摘下，再按新的超时时间放入对应的槽
+void time_wheel::adjust_timer(util_timer *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    list_del(timer);
+    __add_timer(timer);
+}
+
+void time_wheel::del_timer(util_timer *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    list_del(timer);
+    --m_count;
+}
+
+// 从上次处理到的时刻推进到当前时刻，依次取出每个到期槽中的全部定时器批量执行
+void time_wheel::tick()
+{
+    long long cur = get_time_ms();
+    util_timer work;
+
+    while (m_cur <= cur)
+    {
+        if (!m_count)
+        {
+            m_cur = cur + 1;
+            break;
+        }
+
+        int index = m_cur & TVR_MASK;
+        // 第一层转完一圈，从上层逐级降级
+        if (!index)
+        {
+            for (int l = 0; l < TVN_NUM && !cascade(l, index_of(l)); ++l)
+                ;
+        }
+        ++m_cur;
+
+        util_timer *head = &m_tv1[index];
+        if (head->next == head)
+            continue;
+
+        // 整条链表转移到work上再执行，回调中增删定时器不影响本次遍历
+        work.next = head->next;
+        work.prev = head->prev;
+        work.next->prev = &work;
+        work.prev->next = &work;
+        list_init(head);
+
+        while (work.next != &work)
+        {
+            util_timer *tmp = work.next;
+            list_del(tmp);
+            --m_count;
+            tmp->cb_func(tmp->user_data);
+        }
+    }
+}
+
+long long time_wheel::next_expire()
+{
+    long long next = -1;
+    if (!m_count)
+        return next;
+
+    // 第一层的槽只存放[m_cur, m_cur + 256)内到期的定时器，按时间顺序找第一个非空槽
+    for (int k = 0; k < TVR_SIZE; ++k)
+    {
+        util_timer *head = &m_tv1[(m_cur + k) & TVR_MASK];
+        if (head->next != head)
+        {
+            next = m_cur + k;
+            break;
+        }
+    }
+
+    // 上层的槽在下层转完一圈（低位全为0）时降级，降级后其中的定时器可能早于第一层找到的时刻到期
+    for (int l = 0; l < TVN_NUM; ++l)
+    {
+        int shift = TVR_BITS + l * TVN_BITS;
+        long long base = m_cur >> shift;
+        for (int k = 1; k <= TVN_SIZE; ++k)
+        {
+            util_timer *head = &m_tvn[l][(base + k) & TVN_MASK];
+            if (head->next != head)
+            {
+                long long t = (base + k) << shift;
+                if (next < 0 || t < next)
+                    next = t;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+
 /*-------------------------------------- class Utils ------------------------------------ */
-void Utils::init(int timeslot)
+void Utils::init()
 {
-    m_TIMESLOT = timeslot;
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerfd != -1);
+    m_timer_armed = -1;
 }
 
 //对文件描述符设置非阻塞
@@ -206,11 +412,30 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
-//定时处理任务，重新定时以不断触发SIGALRM信号
+//定时处理任务
 void Utils::timer_handler()
 {
+    uint64_t expirations;
+    read(m_timerfd, &expirations, sizeof(expirations));
+    // 已到期，rearm_timer需要按时间轮中最新的最近超时时刻重新设定
+    m_timer_armed = -1;
     m_timer_lst.tick();
-    alarm(m_TIMESLOT);
+}
+
+// 定时器只会被添加或延后，最近的超时时刻变晚时保持原设定，提前到期一次后再按最新时刻重设，
+// 这样大多数事件循环不需要额外的系统调用
+void Utils::rearm_timer()
+{
+    long long next = m_timer_lst.next_expire();
+    if (next < 0 || (m_timer_armed >= 0 && m_timer_armed <= next))
+        return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+    m_timer_armed = next;
 }
 
 void Utils::show_error(int connfd, const char *info)
@@ -226,8 +451,16 @@ int Utils::u_epollfd = 0;
 void cb_func(client_data *user_data)
 {
     _LOG_INFO("close connection by timer->cb_func");
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
-    close(user_data->sockfd);
+    // 清空引用以免完成队列中迟到的记录再次使用它；
+    // 连接对象归还slab后可能立即被其他Reactor取走，先记下fd，之后不再访问user_data
+    int sockfd = user_data->sockfd;
+    user_data->timer = NULL;
     http_conn::m_user_count--;
+    stats::get_instance()->add(stats::CONN_CLOSE);
+    epoll_ctl(user_data->epollfd, EPOLL_CTL_DEL, sockfd, 0);
+    stats::get_instance()->add(stats::SYSCALL);
+    // 必须在close之前摘下，close之后该fd可能已属于其他Reactor接受的新连接
+    conn_table::get_instance()->remove(sockfd);
+    close(sockfd);
 }
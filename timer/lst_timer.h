@@ -20,27 +20,26 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/timerfd.h>
 
 #include <time.h>
 #include "../log/log.h"
+#include "../stats/stats.h"
 
-class util_timer;
+struct client_data;
 
-struct client_data
-{
-    sockaddr_in address;
-    int         sockfd;
-    util_timer* timer;
-};
+// 单调时钟的当前时刻(ms)，定时器的超时时刻均以此为基准，不受系统时间调整的影响
+long long get_time_ms();
 
-// 升序链表结点
+// 定时器结点（升序链表与时间轮共用prev/next指针）
+// 容器只负责链接，不负责结点的分配和释放
 class util_timer
 {
 public:
     util_timer() : prev(NULL), next(NULL) {}
 
 public:
-    time_t expire;
+    long long expire; // 超时时刻(ms)
 
     void (* cb_func)(client_data *);
     client_data *user_data;
@@ -48,6 +47,15 @@ public:
     util_timer *next;
 };
 
+struct client_data
+{
+    sockaddr_in address;
+    int         sockfd;
+    int         epollfd; // 连接所属的epoll内核事件表
+    util_timer* timer;   // 连接存活时指向node，连接关闭后为NULL
+    util_timer  node;    // 内嵌的定时器结点，随连接表一次分配，建立和关闭连接不需要堆分配
+};
+
 // 升序链表
 class sort_timer_lst
 {
@@ -67,13 +75,54 @@ private:
     util_timer *tail;
 };
 
+// 分层时间轮（与Linux内核经典的timer wheel相同）
+// 第一层256个槽，每槽1毫秒；其余四层各64个槽，每层槽的跨度是上一层整层的跨度。
+// 每个槽是带哨兵的双向循环链表，插入、调整、删除均为O(1)；
+// tick时把当前槽整条链表一次取出批量执行，每转完一圈第一层再从上层逐级降级(cascade)一个槽。
+class time_wheel
+{
+public:
+    time_wheel();
+    ~time_wheel();
+
+    void add_timer(util_timer *timer);
+    void adjust_timer(util_timer *timer);
+    void del_timer(util_timer *timer);
+    void tick();
+    // 最近一个需要tick处理的时刻(ms)：第一层最近的非空槽或上层最近一次降级，时间轮为空时返回-1
+    long long next_expire();
+
+private:
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int TVR_MASK = TVR_SIZE - 1;
+    static const int TVN_MASK = TVN_SIZE - 1;
+    static const int TVN_NUM  = 4;
+
+    void __add_timer(util_timer *timer);
+    int  cascade(int level, int index);
+    int  index_of(int level) { return (m_cur >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK; }
+
+    static void list_init(util_timer *head);
+    static void list_add(util_timer *head, util_timer *timer);
+    static void list_del(util_timer *timer);
+
+    util_timer m_tv1[TVR_SIZE];          // 第一层，各槽为链表哨兵
+    util_timer m_tvn[TVN_NUM][TVN_SIZE]; // 其余各层
+    long long  m_cur;                    // 时间轮下一个要处理的时刻(ms)
+    int        m_count;                  // 时间轮中的定时器数量
+};
+
 class Utils
 {
 public:
     Utils() {}
     ~Utils() {}
 
-    void init(int timeslot);
+    // 创建timerfd，由调用者加入epoll内核事件表
+    void init();
 
     //对文件描述符设置非阻塞
     int setnonblocking(int fd);
@@ -87,16 +136,20 @@ public:
     //设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    //定时处理任务，重新定时以不断触发SIGALRM信号
+    //定时处理任务：timerfd到期后读出到期次数并处理到期的定时器
     void timer_handler();
 
+    //将timerfd重设到时间轮中最近的超时时刻，只在该时刻提前时才调用timerfd_settime
+    void rearm_timer();
+
     void show_error(int connfd, const char *info);
 
 public:
     static int*    u_pipefd;
-    sort_timer_lst m_timer_lst;
+    time_wheel     m_timer_lst;
     static int     u_epollfd;
-    int            m_TIMESLOT;
+    int            m_timerfd;
+    long long      m_timer_armed; // timerfd当前设定的到期时刻(ms)，-1表示未设定
 };
 
 void cb_func(client_data *user_data);
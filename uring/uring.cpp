@@ -0,0 +1,260 @@
+#include "uring.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    int ret = syscall(__NR_io_uring_setup, entries, p);
+    return ret < 0 ? -errno : ret;
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    int ret = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    int ret = syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+    return ret < 0 ? -errno : ret;
+}
+
+uring::uring()
+{
+    m_ring_fd       = -1;
+    m_sqes          = NULL;
+    m_sqe_tail      = 0;
+    m_sqe_head      = 0;
+    m_sq_ptr        = MAP_FAILED;
+    m_sq_size       = 0;
+    m_cq_ptr        = MAP_FAILED;
+    m_cq_size       = 0;
+    m_sqes_size     = 0;
+    m_buf_ring      = NULL;
+    m_buf_ring_size = 0;
+    m_bufs          = NULL;
+    m_buf_count     = 0;
+    m_buf_size      = 0;
+}
+
+uring::~uring()
+{
+    if (m_bufs)
+        free(m_bufs);
+    if (m_buf_ring)
+        munmap(m_buf_ring, m_buf_ring_size);
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_ring_fd >= 0)
+        close(m_ring_fd);
+}
+
+bool uring::init(unsigned entries, unsigned buf_count, unsigned buf_size)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // multishot accept在连接突发时会产生大量完成事件，完成队列设为提交队列的4倍
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    m_ring_fd = io_uring_setup(entries, &p);
+    if (m_ring_fd < 0)
+        return false;
+    m_sq_entries = p.sq_entries;
+
+    // 映射提交队列和完成队列，支持IORING_FEAT_SINGLE_MMAP的内核只需映射一次
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+        return false;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head  = (unsigned *)(sq + p.sq_off.head);
+    m_sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+    m_sqe_tail = m_sqe_head = *m_sq_tail;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+    m_sqes = (struct io_uring_sqe *)sqes;
+
+    // 注册provided buffer ring：recv完成时由内核从中挑选缓冲区，空闲连接不再占用读缓冲区
+    m_buf_count = buf_count;
+    m_buf_size  = buf_size;
+    m_buf_ring_size = buf_count * sizeof(struct io_uring_buf);
+    void *ring = mmap(0, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+    m_buf_ring = (struct io_uring_buf_ring *)ring;
+    m_buf_ring->tail = 0;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)m_buf_ring;
+    reg.ring_entries = buf_count;
+    reg.bgid         = BUF_GROUP;
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return false;
+
+    m_bufs = (char *)malloc((size_t)buf_count * buf_size);
+    if (!m_bufs)
+        return false;
+    for (unsigned i = 0; i < buf_count; ++i)
+        recycle_buf(i);
+
+    return true;
+}
+
+void uring::recycle_buf(unsigned bid)
+{
+    // 部分版本的内核头文件在C++下会使bufs成员偏移8字节，这里直接以环首地址作为缓冲区数组
+    struct io_uring_buf *bufs = (struct io_uring_buf *)m_buf_ring;
+    unsigned short tail = m_buf_ring->tail;
+    struct io_uring_buf *buf = &bufs[tail & (m_buf_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)get_buf(bid);
+    buf->len  = m_buf_size;
+    buf->bid  = bid;
+    __atomic_store_n(&m_buf_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+bool uring::reserve(unsigned n)
+{
+    // 提交队列剩余空间不足时先提交一次腾出空间
+    if (m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) + n <= m_sq_entries)
+        return true;
+    submit_and_wait(0);
+    return m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) + n <= m_sq_entries;
+}
+
+struct io_uring_sqe *uring::get_sqe()
+{
+    if (!reserve(1))
+        return NULL;
+    unsigned idx = m_sqe_tail & *m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    ++m_sqe_tail;
+    return sqe;
+}
+
+void uring::prep_accept_multishot(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode    = IORING_OP_ACCEPT;
+    sqe->fd        = fd;
+    sqe->ioprio    = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_recv(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = fd;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_send(int fd, const void *buf, size_t len, uint64_t user_data, bool link)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)(uintptr_t)buf;
+    sqe->len       = len;
+    // MSG_WAITALL使内核在socket缓冲区满时等待并继续发送，而不是返回部分发送的结果打断链接；
+    // 链中除最后一环外都带MSG_MORE，多个小段合并成满的报文段发出，不会被Nagle算法逐段推迟
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL | (link ? MSG_MORE : 0);
+    sqe->flags     = link ? IOSQE_IO_LINK : 0;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_close(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode    = IORING_OP_CLOSE;
+    sqe->fd        = fd;
+    sqe->user_data = user_data;
+}
+
+void uring::prep_poll_multishot(int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len           = IORING_POLL_ADD_MULTI;
+    sqe->user_data     = user_data;
+}
+
+int uring::submit_and_wait(unsigned wait_nr)
+{
+    unsigned to_submit = m_sqe_tail - m_sqe_head;
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    m_sqe_head = m_sqe_tail;
+
+    if (to_submit == 0 && wait_nr == 0)
+        return 0;
+    return io_uring_enter(m_ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+bool uring::peek_cqe(struct io_uring_cqe **cqe)
+{
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+    *cqe = &m_cqes[head & *m_cq_mask];
+    return true;
+}
+
+void uring::cqe_seen()
+{
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
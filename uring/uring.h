@@ -0,0 +1,79 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+// 直接基于io_uring系统调用的轻量封装（不依赖liburing）
+// 只实现服务器用到的操作：multishot accept、基于provided buffer ring的recv、链式send、close和multishot poll
+// 非线程安全，所有操作都应在事件循环线程中调用
+class uring
+{
+public:
+    uring();
+    ~uring();
+
+    // entries为提交队列大小；buf_count/buf_size为provided buffer ring中缓冲区的个数和大小（buf_count须为2的幂）
+    bool init(unsigned entries, unsigned buf_count, unsigned buf_size);
+
+    void prep_accept_multishot(int fd, uint64_t user_data);
+    void prep_recv(int fd, uint64_t user_data);                 // 从provided buffer ring中选择缓冲区
+    // 链式send须先用reserve为整条链预留空间，准备到一半时不能因提交队列满而提交或失败
+    void prep_send(int fd, const void *buf, size_t len, uint64_t user_data, bool link);
+    void prep_close(int fd, uint64_t user_data);
+    void prep_poll_multishot(int fd, uint64_t user_data);
+
+    // 确保提交队列中还能准备n个SQE，空间不足时先提交已准备的SQE，仍不足返回false
+    bool reserve(unsigned n);
+
+    // 提交所有已准备的SQE，并至少等待wait_nr个完成事件，返回值同io_uring_enter（失败为-errno）
+    int submit_and_wait(unsigned wait_nr);
+
+    // 取出一个完成事件，无完成事件时返回false；处理完后必须调用cqe_seen
+    bool peek_cqe(struct io_uring_cqe **cqe);
+    void cqe_seen();
+
+    // provided buffer ring相关：取得缓冲区地址，以及用完后归还
+    char *get_buf(unsigned bid) { return m_bufs + (size_t)bid * m_buf_size; }
+    void  recycle_buf(unsigned bid);
+
+    static const unsigned BUF_GROUP = 0;
+
+private:
+    struct io_uring_sqe *get_sqe();
+
+    int        m_ring_fd;
+    unsigned   m_sq_entries;
+
+    // 提交队列
+    unsigned*  m_sq_head;
+    unsigned*  m_sq_tail;
+    unsigned*  m_sq_mask;
+    unsigned*  m_sq_array;
+    struct io_uring_sqe* m_sqes;
+    unsigned   m_sqe_tail;      // 本地已准备的SQE尾部，提交时才写回内核
+    unsigned   m_sqe_head;      // 本地已提交的SQE位置
+
+    // 完成队列
+    unsigned*  m_cq_head;
+    unsigned*  m_cq_tail;
+    unsigned*  m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    void*      m_sq_ptr;
+    size_t     m_sq_size;
+    void*      m_cq_ptr;
+    size_t     m_cq_size;
+    size_t     m_sqes_size;
+
+    // provided buffer ring
+    struct io_uring_buf_ring* m_buf_ring;
+    size_t     m_buf_ring_size;
+    char*      m_bufs;
+    unsigned   m_buf_count;
+    unsigned   m_buf_size;
+};
+
+#endif
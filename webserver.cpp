@@ -1,9 +1,53 @@
 #include "webserver.h"
 
+// io_uring后端每个SQE的user_data：高8位为操作类型，中间24位为连接代数，低32位为fd
+enum URING_OP
+{
+    URING_ACCEPT = 1,
+    URING_SIGNAL,
+    URING_TIMER,
+    URING_COMPLETION,
+    URING_RECV,
+    URING_SEND,         // 链式send中间的一环
+    URING_SEND_LAST,    // 链式send的最后一环，完成时统一检查发送结果
+    URING_CLOSE
+};
+
+static inline uint64_t uring_data(int op, int fd, unsigned gen)
+{
+    return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+}
+
+static uring *s_uring = NULL;
+
+// io_uring后端的定时器回调：连接上可能还有未完成的recv，先shutdown使其立即返回，再提交异步close
+static void uring_cb_func(client_data *user_data)
+{
+    int sockfd = user_data->sockfd;
+    shutdown(sockfd, SHUT_RDWR);
+    s_uring->prep_close(sockfd, uring_data(URING_CLOSE, sockfd, 0));
+    user_data->timer = NULL;
+    http_conn::m_user_count--;
+    stats::get_instance()->add(stats::CONN_CLOSE);
+
+    // 归还连接暂存的provided buffer后再把连接对象归还slab；
+    // 异步close完成之前fd不会被复用，此后到达的recv完成事件因连接已不在表中而回收其缓冲区
+    conn_slot *c = conn_table::get_instance()->get(sockfd);
+    if (c->held.bid >= 0)
+    {
+        s_uring->recycle_buf(c->held.bid);
+        c->held.bid = -1;
+    }
+    conn_table::get_instance()->remove(sockfd);
+}
+
 WebServer::WebServer()
 {
-    //http_conn类对象
-    users = new http_conn[MAX_FD];
+    m_main_reactor = NULL;
+    m_listenfd = -1;
+    m_completion = NULL;
+    m_uring = NULL;
+    m_conns = NULL;
 
     //root文件夹路径
     char server_path[200];
@@ -12,9 +56,48 @@ WebServer::WebServer()
     m_root = (char *)malloc(strlen(server_path) + strlen(root) + 1);
     strcpy(m_root, server_path);
     strcat(m_root, root);
+}
 
-    //定时器
-    users_timer = new client_data[MAX_FD];
+// 从Reactor：连接表以fd为下标，各从Reactor接受的fd互不相同，因此共享同一张表而不会冲突
+WebServer::WebServer(WebServer *main_reactor)
+{
+    m_main_reactor = main_reactor;
+    m_listenfd = -1;
+
+    m_conns       = main_reactor->m_conns;
+    m_root        = main_reactor->m_root;
+    m_threadPool  = main_reactor->m_threadPool;
+    m_sqlConnPool = main_reactor->m_sqlConnPool;
+    m_completion  = NULL;
+    m_uring       = NULL;
+
+    m_port           = main_reactor->m_port;
+    m_user           = main_reactor->m_user;
+    m_passWord       = main_reactor->m_passWord;
+    m_databaseName   = main_reactor->m_databaseName;
+    m_sql_num        = main_reactor->m_sql_num;
+    m_sql_min        = main_reactor->m_sql_min;
+    m_thread_num     = main_reactor->m_thread_num;
+    m_log_write      = main_reactor->m_log_write;
+    m_close_log      = main_reactor->m_close_log;
+    m_actormodel     = main_reactor->m_actormodel;
+    m_reactor_num    = 0;
+    m_event_backend  = 0;
+    m_idle_timeout   = main_reactor->m_idle_timeout;
+    m_zero_copy      = main_reactor->m_zero_copy;
+    m_file_cache     = main_reactor->m_file_cache;
+    m_max_conn       = main_reactor->m_max_conn;
+    m_work_steal     = main_reactor->m_work_steal;
+    m_max_thread     = main_reactor->m_max_thread;
+    m_db_thread      = main_reactor->m_db_thread;
+    m_hybrid         = main_reactor->m_hybrid;
+    m_persist        = main_reactor->m_persist;
+    m_async_sql      = main_reactor->m_async_sql;
+    m_affine_sql     = main_reactor->m_affine_sql;
+    m_OPT_LINGER     = main_reactor->m_OPT_LINGER;
+    m_TRIGMode       = main_reactor->m_TRIGMode;
+    m_LISTENTrigmode = main_reactor->m_LISTENTrigmode;
+    m_CONNTrigmode   = main_reactor->m_CONNTrigmode;
 }
 
 WebServer::~WebServer()
@@ -23,35 +106,76 @@ WebServer::~WebServer()
     close(m_listenfd);
     close(m_pipefd[1]);
     close(m_pipefd[0]);
-    delete[] users;
-    delete[] users_timer;
+    close(utils.m_timerfd);
+
+    // 从Reactor不拥有共享的连接表和线程池，只拥有自己的完成队列
+    if (m_main_reactor)
+    {
+        delete m_completion;
+        return;
+    }
+
+    // 查询线程会把完成的请求交还线程池，先于线程池停止
+    if (m_async_sql)
+        sql_async::GetInstance()->stop();
+    // 工作线程会向各Reactor的完成队列提交关闭记录，先于各Reactor销毁
     delete m_threadPool;
+    for (size_t i = 0; i < m_sub_reactors.size(); ++i)
+        delete m_sub_reactors[i];
+    delete m_completion;
+    delete m_uring;
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model,
+                     int reactor_num, int event_backend, int idle_timeout, int zero_copy, int file_cache,
+                     int max_conn, int work_steal, int max_thread, int db_thread, int hybrid, int persist,
+                     int async_sql, int affine_sql, int sql_min)
 {
     m_port = port;
     m_user = user;
     m_passWord = passWord;
     m_databaseName = databaseName;
     m_sql_num = sql_num;
+    m_sql_min = sql_min;
     m_thread_num = thread_num;
     m_log_write = log_write;
     m_OPT_LINGER = opt_linger;
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_reactor_num = reactor_num;
+    m_event_backend = event_backend;
+    m_idle_timeout = idle_timeout;
+    m_zero_copy = zero_copy;
+    m_file_cache = file_cache;
+    m_max_conn = max_conn;
+    m_work_steal = work_steal;
+    m_max_thread = max_thread;
+    m_db_thread = db_thread;
+    m_hybrid = hybrid;
+    // Reactor模式由工作线程读写，仍逐次重新注册事件
+    m_persist = persist && 1 != actor_model;
+    m_async_sql = async_sql;
+    m_affine_sql = affine_sql;
 }
 
 
 void WebServer::run() {
     log_write();      // 日志
+    connections();    // 连接表
     sql_pool();       // 数据库
+    event_backend();  // 事件后端
     thread_pool();    // 线程池
+    cache();          // 静态资源缓存
     trig_mode();      // 触发模式
     eventListen();    // 监听
-    eventLoop();      // 运行
+    if (2 == m_actormodel)
+        sub_reactor();  // 启动从Reactor
+    if (m_uring)
+        uringLoop();  // 运行
+    else
+        eventLoop();  // 运行
 }
 
 
@@ -83,6 +207,31 @@ void WebServer::trig_mode()
     }
 }
 
+// 选择事件后端：io_uring初始化失败（如内核过旧或被禁用）时回退到epoll
+void WebServer::event_backend()
+{
+    if (1 != m_event_backend)
+        return;
+
+    // io_uring后端目前只支持Proactor模型
+    if (0 != m_actormodel)
+    {
+        LOG_ERROR("%s", "io_uring backend only supports proactor model, fall back to epoll");
+        return;
+    }
+
+    m_uring = new uring;
+    if (!m_uring->init(4096, 1024, http_conn::READ_BUFFER_SIZE))
+    {
+        LOG_ERROR("io_uring init failed(errno=%d), fall back to epoll", errno);
+        delete m_uring;
+        m_uring = NULL;
+        return;
+    }
+    s_uring = m_uring;
+    LOG_INFO("%s", "use io_uring event backend");
+}
+
 void WebServer::log_write()
 {
     if (0 == m_close_log)
@@ -99,62 +248,132 @@ void WebServer::sql_pool()
 {
     //初始化数据库连接池
     m_sqlConnPool = sql_connection_pool::GetInstance();
-    m_sqlConnPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
+    m_sqlConnPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log, m_sql_min);
+
+    //非阻塞查询使用单独的一组连接，查询完成的请求交还线程池
+    sql_async *sqlAsync = NULL;
+    if (m_async_sql)
+    {
+        sqlAsync = sql_async::GetInstance();
+        sqlAsync->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log, sql_resume, this);
+    }
 
     //初始化数据库读取表
-    users->initmysql_result(m_sqlConnPool);
+    http_conn::initmysql_result(m_sqlConnPool, m_close_log, sqlAsync);
+
+    //启动阶段的查询在主线程上完成之后才开启线程独占，主线程不占用连接。
+    //连接数须多于线程池可能达到的线程数：否则部分线程独占的连接在其处理静态请求时闲置，
+    //其余线程却只能争用剩下的少数连接
+    int max_threads = m_max_thread > m_thread_num ? m_max_thread : m_thread_num;
+    if (m_affine_sql && m_sql_num <= max_threads)
+    {
+        LOG_ERROR("sql_num %d not greater than thread num %d, thread affine connections disabled", m_sql_num, max_threads);
+        m_affine_sql = 0;
+    }
+    m_sqlConnPool->SetThreadAffine(m_affine_sql);
+}
+
+// 在查询线程上调用，线程池在查询开始之前已创建
+void WebServer::sql_resume(http_conn *request, unsigned int generation, void *arg)
+{
+    WebServer *server = (WebServer *)arg;
+    if (!server->m_threadPool->resume(request, generation))
+    {
+        int m_close_log = server->m_close_log; // 日志宏使用m_close_log
+        LOG_ERROR("%s", "work queue full, drop resumed request");
+    }
 }
 
 void WebServer::thread_pool()
 {
-    //线程池
-    m_threadPool = new threadpool<http_conn>(m_actormodel, m_sqlConnPool, m_thread_num);
+    //Reactor模式及io_uring后端下工作线程通过完成队列把处理结果交还主线程
+    if (1 == m_actormodel || m_uring)
+        m_completion = new completion_queue;
+
+    //线程池，任务的排队期限与连接的超时时间相同：超过它时客户端已不再等待，连接的定时器也即将关闭连接
+    m_threadPool = new threadpool<http_conn>(m_actormodel, m_completion, m_thread_num, m_work_steal, m_max_thread,
+                                             m_db_thread, m_idle_timeout);
 }
 
-void WebServer::eventListen()
+void WebServer::cache()
 {
-    //网络编程基础步骤
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+    file_cache::get_instance()->init(m_file_cache, FILE_CACHE_BYTES, RESPONSE_CACHE_SIZE, http_conn::file_header);
+}
 
-    // 优雅关闭连接
-    // 不启用时：close函数立即返回，直接丢弃缓冲区的数据
-    // 启用时：close函数不立即返回，如果在x秒内没有发送完缓冲区数据，则丢弃缓冲区的数据。
-    if (0 == m_OPT_LINGER)
-    {
-        struct linger tmp = {0, 1}; // { 关0/开1, 等待时间 }
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
-    }
-    else if (1 == m_OPT_LINGER)
+// 连接表的fd上限取进程的fd上限（先把软限制提高到硬限制），启动时只分配一级目录，
+// 连接对象在accept时才从slab中分配
+void WebServer::connections()
+{
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < rl.rlim_max)
     {
-        struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        rlim_t cur = rl.rlim_cur;
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+            rl.rlim_cur = cur;
     }
+    int max_fd = rl.rlim_cur > (rlim_t)INT_MAX ? INT_MAX : (int)rl.rlim_cur;
 
+    if (m_max_conn <= 0 || m_max_conn > max_fd)
+        m_max_conn = max_fd;
+    m_conns = conn_table::get_instance();
+    m_conns->init(max_fd);
+    LOG_INFO("max fd %d, max connections %d", max_fd, m_max_conn);
+}
+
+void WebServer::eventListen()
+{
     int ret = 0;
-    struct sockaddr_in address;
-    bzero(&address, sizeof(address));
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = htons(m_port);
 
-    int flag = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
-    assert(ret >= 0);
-    ret = listen(m_listenfd, 5);
-    assert(ret >= 0);
+    // 多Reactor模式下主Reactor不监听端口，只负责接收信号并转发给各从Reactor
+    if (2 != m_actormodel || m_main_reactor)
+    {
+        //网络编程基础步骤
+        m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
+        assert(m_listenfd >= 0);
+
+        // 优雅关闭连接
+        // 不启用时：close函数立即返回，直接丢弃缓冲区的数据
+        // 启用时：close函数不立即返回，如果在x秒内没有发送完缓冲区数据，则丢弃缓冲区的数据。
+        if (0 == m_OPT_LINGER)
+        {
+            struct linger tmp = {0, 1}; // { 关0/开1, 等待时间 }
+            setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        }
+        else if (1 == m_OPT_LINGER)
+        {
+            struct linger tmp = {1, 1};
+            setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        }
+
+        struct sockaddr_in address;
+        bzero(&address, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(m_port);
+
+        int flag = 1;
+        setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        // 每个从Reactor在同一端口上各自监听，由内核把新连接分散到各个从Reactor
+        if (m_main_reactor)
+            setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+        assert(ret >= 0);
+        // 大量连接同时到达时，过短的全连接队列会使内核丢弃握手，客户端要等SYN重传
+        ret = listen(m_listenfd, SOMAXCONN);
+        assert(ret >= 0);
+    }
 
-    utils.init(TIMESLOT);
+    utils.init();
 
     //epoll创建内核事件表
-    epoll_event events[MAX_EVENT_NUMBER];
     m_epollfd = epoll_create(5);
     assert(m_epollfd != -1);
 
     // 将监听套接字加入epoll监视列表
-    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
-    http_conn::m_epollfd = m_epollfd;
+    if (m_listenfd >= 0)
+        utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
 
     // 创建信号管道并将其加入epoll监视列表
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
@@ -162,42 +381,102 @@ void WebServer::eventListen()
     utils.setnonblocking(m_pipefd[1]);
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
 
+    // 定时器由timerfd驱动，每个Reactor各自监视自己的timerfd
+    utils.addfd(m_epollfd, utils.m_timerfd, false, 0);
+
+    // 所有权模式下持有者通过各Reactor自己的完成队列提交关闭记录(工作线程不使用它，线程池创建时不需要)
+    if (m_persist && !m_completion)
+        m_completion = new completion_queue;
+
+    // 将完成队列的eventfd加入epoll监视列表
+    if (m_completion)
+        utils.addfd(m_epollfd, m_completion->get_eventfd(), false, 0);
+
+    // 信号只由主Reactor处理，从Reactor的管道由主Reactor写入转发的信号
+    if (m_main_reactor)
+        return;
+
     utils.addsig(SIGPIPE, SIG_IGN);                  // 安全地屏蔽SIGPIPE
-    utils.addsig(SIGALRM, utils.sig_handler, false); // alarm函数发送的信号
     utils.addsig(SIGTERM, utils.sig_handler, false); // kill不加参数发送的信号
     utils.addsig(SIGINT , utils.sig_handler, false); // Ctrl + C发送的信号
-
-    // 发送初始定时信号以驱动定时器运转
-    alarm(TIMESLOT); // 发送SIGALRM信号，如果未设置handler，该信号触发的行为时终止进程
+    utils.addsig(SIGUSR1, utils.sig_handler, false); // kill -USR1输出运行统计
 
     //工具类,信号和描述符基础操作
     Utils::u_pipefd  = m_pipefd;
     Utils::u_epollfd = m_epollfd;
 }
 
+// 创建并启动从Reactor线程，每个线程运行自己的eventLoop
+void WebServer::sub_reactor()
+{
+    if (m_reactor_num <= 0)
+        m_reactor_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        WebServer *sub = new WebServer(this);
+        sub->eventListen();
+        m_sub_reactors.push_back(sub);
+    }
+
+    m_reactor_threads.resize(m_reactor_num);
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        int ret = pthread_create(&m_reactor_threads[i], NULL, sub_reactor_worker, m_sub_reactors[i]);
+        assert(ret == 0);
+    }
+    LOG_INFO("start %d sub reactors", m_reactor_num);
+}
+
+void *WebServer::sub_reactor_worker(void *arg)
+{
+    WebServer *reactor = (WebServer *)arg;
+    reactor->eventLoop();
+    return reactor;
+}
+
+// 将主Reactor收到的信号原样写入各从Reactor的信号管道
+void WebServer::forward_signal(const char *signals, int len)
+{
+    for (size_t i = 0; i < m_sub_reactors.size(); ++i)
+    {
+        send(m_sub_reactors[i]->m_pipefd[1], signals, len, 0);
+    }
+}
+
 void WebServer::add_timer(int connfd, struct sockaddr_in client_address)
 {
     // 初始化http连接
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
+    // io_uring后端不使用epoll，连接的epollfd为-1
+    int epollfd = m_uring ? -1 : m_epollfd;
+    // io_uring后端由事件循环提交send，文件内容需要映射到内存，不使用sendfile
+    int zero_copy = m_uring ? 0 : m_zero_copy;
+    conn_slot *c = m_conns->alloc(connfd);
+    c->http.init(connfd, client_address, epollfd, m_root, m_CONNTrigmode, m_close_log, zero_copy, m_persist,
+                 m_persist ? m_completion : NULL);
 
     //初始化client_data数据
-    //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
-    users_timer[connfd].address = client_address;
-    users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
-    timer->user_data = &users_timer[connfd];
-    timer->cb_func = cb_func;
-    timer->expire = time(NULL) + 3 * TIMESLOT;
-    users_timer[connfd].timer = timer;
+    //使用内嵌的定时器结点，设置回调函数和超时时间，绑定用户数据，将定时器添加到时间轮中
+    //连接只由持有其定时器的Reactor关闭，关闭时定时器已从时间轮摘下，这里的结点一定是空闲的
+    client_data &data = c->client;
+    assert(!data.timer);
+    data.address = client_address;
+    data.sockfd = connfd;
+    data.epollfd = epollfd;
+    util_timer *timer = &data.node;
+    timer->user_data = &data;
+    timer->cb_func = m_uring ? uring_cb_func : cb_func;
+    timer->expire = get_time_ms() + m_idle_timeout;
+    data.timer = timer;
     utils.m_timer_lst.add_timer(timer);
+    stats::get_instance()->add(stats::CONN_ACCEPT);
 }
 
-//若有数据传输，则将定时器往后延迟3个单位
-//并对新的定时器在链表上的位置进行调整
+//若有数据传输，则将定时器的超时时刻延后到m_idle_timeout毫秒之后
+//并对新的定时器在时间轮上的位置进行调整
 void WebServer::adjust_timer(util_timer *timer)
 {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    timer->expire = get_time_ms() + m_idle_timeout;
     utils.m_timer_lst.adjust_timer(timer);
 
     LOG_INFO("%s", "adjust timer once");
@@ -206,13 +485,15 @@ void WebServer::adjust_timer(util_timer *timer)
 // 关闭连接，删除timer
 void WebServer::del_timer(util_timer *timer, int sockfd)
 {
-    timer->cb_func(&users_timer[sockfd]);
-    if (timer)
+    if (!timer)
     {
-        utils.m_timer_lst.del_timer(timer);
+        return;
     }
+    // 先摘下定时器再关闭连接：fd关闭后可能立即被其他Reactor复用，之后不能再访问该fd的定时器结点
+    utils.m_timer_lst.del_timer(timer);
+    timer->cb_func(timer->user_data);
 
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
+    LOG_INFO("close fd %d", sockfd);
 }
 
 bool WebServer::deal_newclient()
@@ -230,7 +511,7 @@ bool WebServer::deal_newclient()
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
             return false;
         }
-        if (http_conn::m_user_count >= MAX_FD)
+        if (http_conn::m_user_count >= m_max_conn || connfd >= m_conns->max_fd())
         {
             utils.show_error(connfd, "Internal server busy");
             LOG_ERROR("%s", "Internal server busy");
@@ -249,7 +530,7 @@ bool WebServer::deal_newclient()
                 LOG_ERROR("%s:errno is:%d", "accept error", errno);
                 break;
             }
-            if (http_conn::m_user_count >= MAX_FD)
+            if (http_conn::m_user_count >= m_max_conn || connfd >= m_conns->max_fd())
             {
                 utils.show_error(connfd, "Internal server busy");
                 LOG_ERROR("%s", "Internal server busy");
@@ -262,7 +543,7 @@ bool WebServer::deal_newclient()
     return true;
 }
 
-bool WebServer::dealwith_signal(bool &timeout, bool &stop_server)
+bool WebServer::dealwith_signal(bool &stop_server)
 {
     int ret = 0;
     int sig;
@@ -278,15 +559,13 @@ bool WebServer::dealwith_signal(bool &timeout, bool &stop_server)
     }
     else
     {
+        if (!m_sub_reactors.empty())
+            forward_signal(signals, ret);
+
         for (int i = 0; i < ret; ++i)
         {
             switch (signals[i])
             {
-            case SIGALRM:
-            {
-                timeout = true;
-                break;
-            }
             case SIGTERM:
             {
                 printf("\nserver closed by signal[SIGTERM]\n");
@@ -301,6 +580,13 @@ bool WebServer::dealwith_signal(bool &timeout, bool &stop_server)
                 stop_server = true;
                 break;
             }
+            case SIGUSR1:
+            {
+                // 统计是全局的，从Reactor收到转发的信号时不重复输出
+                if (!m_main_reactor)
+                    dump_stats();
+                break;
+            }
             }
         }
     }
@@ -309,7 +595,11 @@ bool WebServer::dealwith_signal(bool &timeout, bool &stop_server)
 
 void WebServer::dealwith_read(int sockfd)
 {
-    util_timer *timer = users_timer[sockfd].timer;
+    // 连接已在本轮较早的事件中关闭
+    conn_slot *c = m_conns->get(sockfd);
+    if (!c)
+        return;
+    util_timer *timer = c->client.timer;
 
     //reactor
     if (1 == m_actormodel)
@@ -319,38 +609,19 @@ void WebServer::dealwith_read(int sockfd)
             adjust_timer(timer);
         }
 
-        //若监测到读事件，将该事件放入请求队列
-        m_threadPool->append(users + sockfd, threadpool<http_conn>::IOState::READ);
-
-        // improv和timer_flag的作用为“Reactor模式下，当子线程执行读写任务出错时，来通知主线程关闭子线程的客户连接”。
-        //      对于improv标志，其作用是保持主线程和子线程的同步；
-        //      对于time_flag标志，其作用是标识子线程读写任务是否成功。
-        while (true)
-        {
-            // 一直等待，直到线程池中线程正在执行的的run函数处理完读/写任务后，将improv标志设为1
-            if (1 == users[sockfd].improv)
-            {
-                // 如果处理失败我们需要将timr_flag设为1，调用del_timer函数，关闭连接、删除timer
-                if (1 == users[sockfd].timer_flag)
-                {
-                    del_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        //若监测到读事件，将该事件放入请求队列，读写结果由工作线程通过完成队列异步返回
+        m_threadPool->append(&c->http, threadpool<http_conn>::IOState::READ);
     }
     //proactor
     else
     {
-        if (users[sockfd].read_once())
+        if (c->http.read_once())
         {
             LOG_INFO("deal with the client(%s)",
-                inet_ntoa(users[sockfd].get_address()->sin_addr));
+                inet_ntoa(c->http.get_address()->sin_addr));
 
             //若监测到读事件，将该事件放入请求队列
-            m_threadPool->append_p(users + sockfd);
+            dispatch(&c->http);
 
             if (timer)
             {
@@ -364,9 +635,58 @@ void WebServer::dealwith_read(int sockfd)
     }
 }
 
+// Proactor模式下把已读入的请求交给线程池。混合模式下先在本线程处理：缓存命中或小文件的静态请求
+// 不值得一次跨线程交接和唤醒，直接生成响应；遇到访问数据库或打开大文件的请求时再交给线程池，
+// 由工作线程从该请求继续。返回true表示已在本线程处理完毕
+bool WebServer::dispatch(http_conn *request)
+{
+    if (m_hybrid && request->process_inline())
+    {
+        stats::get_instance()->add(stats::REQUEST_INLINE);
+        return true;
+    }
+    m_threadPool->append_p(request);
+    return false;
+}
+
+// 所有权模式：连接的事件只在accept时注册一次，不再逐次重新注册。
+// 连接空闲时由本线程取得所有权，发送积压的响应并读入新请求，需要处理时连同所有权交给线程池；
+// 连接正由其他线程处理时事件只登记给持有者，由持有者交出所有权前自己再检查一次
+void WebServer::dealwith_event(int sockfd, uint32_t events)
+{
+    conn_slot *c = m_conns->get(sockfd);
+    if (!c)
+        return;
+    util_timer *timer = c->client.timer;
+
+    if (!c->http.acquire())
+    {
+        // 持有者已决定关闭连接，其shutdown产生的事件到达时在此关闭
+        if (c->http.closing())
+            del_timer(timer, sockfd);
+        return;
+    }
+    if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+    {
+        del_timer(timer, sockfd);
+        return;
+    }
+    if (timer)
+        adjust_timer(timer);
+
+    // 在本线程处理完毕时可能已决定关闭连接，本线程持有所有权，直接关闭
+    if (c->http.advance(events & EPOLLIN, false) && !dispatch(&c->http))
+        return;
+    if (c->http.closing())
+        del_timer(timer, sockfd);
+}
+
 void WebServer::dealwith_write(int sockfd)
 {
-    util_timer *timer = users_timer[sockfd].timer;
+    conn_slot *c = m_conns->get(sockfd);
+    if (!c)
+        return;
+    util_timer *timer = c->client.timer;
     //reactor
     if (1 == m_actormodel)
     {
@@ -375,29 +695,19 @@ void WebServer::dealwith_write(int sockfd)
             adjust_timer(timer);
         }
 
-        m_threadPool->append(users + sockfd, threadpool<http_conn>::IOState::WRITE);
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    del_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        m_threadPool->append(&c->http, threadpool<http_conn>::IOState::WRITE);
     }
     //proactor
     else
     {
-        if (users[sockfd].write())
+        if (c->http.write())
         {
             LOG_INFO("send data to the client(%s)",
-                inet_ntoa(users[sockfd].get_address()->sin_addr));
+                inet_ntoa(c->http.get_address()->sin_addr));
+
+            //读缓冲区中还有流水线请求，不等待读事件，直接放入请求队列
+            if (c->http.has_pending_request())
+                dispatch(&c->http);
 
             if (timer)
             {
@@ -411,14 +721,36 @@ void WebServer::dealwith_write(int sockfd)
     }
 }
 
+// 批量处理工作线程返回的完成记录，读写失败或持有者已决定关闭(所有权模式)的连接在此关闭并删除定时器。
+// 记录所属的连接已关闭、fd已属于新连接时代数不同，丢弃该记录，不能关闭新连接
+void WebServer::dealwith_completion()
+{
+    m_completion->reap(m_completions);
+    for (size_t i = 0; i < m_completions.size(); ++i)
+    {
+        if (m_completions[i].ok)
+            continue;
+
+        int sockfd = m_completions[i].sockfd;
+        conn_slot *c = m_conns->get(sockfd);
+        if (c && c->client.timer && c->http.get_generation() == m_completions[i].generation)
+        {
+            del_timer(c->client.timer, sockfd);
+        }
+    }
+    m_completions.clear();
+}
+
 void WebServer::eventLoop()
 {
     bool timeout = false;
+    bool completed = false;
     bool stop_server = false;
 
     while (!stop_server)
     {
         int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        stats::get_instance()->add(stats::SYSCALL);
         if (number < 0 && errno != EINTR)
         {
             LOG_ERROR("%s", "epoll failure");
@@ -436,17 +768,34 @@ void WebServer::eventLoop()
                 if (false == flag)
                     continue;
             }
+            // 定时器到期，留到本轮I/O事件处理完之后再处理
+            else if (sockfd == utils.m_timerfd)
+            {
+                timeout = true;
+            }
+            // 工作线程返回的读写结果和关闭记录，也留到本轮I/O事件处理完之后再处理：
+            // 在此关闭的fd可能被本轮随后的accept复用，本轮中属于旧连接的事件会落到新连接上
+            else if (m_completion && sockfd == m_completion->get_eventfd())
+            {
+                completed = true;
+            }
+            // 所有权模式：连接的所有事件统一处理
+            else if (m_persist && sockfd != m_pipefd[0])
+            {
+                dealwith_event(sockfd, events[i].events);
+            }
             /* 如果发生以下三个事件，则服务器端关闭连接，移除对应的定时器
                 | EPOLLRDHUP: 表示读关闭 | EPOLLHUP: 表示读写都关闭 | EPOLLERR: 发生错误 | */
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
-                util_timer *timer = users_timer[sockfd].timer;
-                del_timer(timer, sockfd);
+                conn_slot *c = m_conns->get(sockfd);
+                if (c)
+                    del_timer(c->client.timer, sockfd);
             }
             // 处理信号
             else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
             {
-                bool flag = dealwith_signal(timeout, stop_server);
+                bool flag = dealwith_signal(stop_server);
                 if (false == flag)
                     LOG_ERROR("%s", "dealclientdata failure");
             }
@@ -460,11 +809,346 @@ void WebServer::eventLoop()
                 dealwith_write(sockfd);
             }
         }
+        if (completed)
+        {
+            dealwith_completion();
+            completed = false;
+        }
+        if (timeout)
+        {
+            utils.timer_handler();
+            LOG_INFO("%s", "timer tick");
+            timeout = false;
+        }
+        // 本轮新增或延后的定时器可能改变最近的超时时刻
+        utils.rearm_timer();
+    }
+
+    // 主Reactor退出前等待所有从Reactor结束
+    for (size_t i = 0; i < m_reactor_threads.size(); ++i)
+    {
+        pthread_join(m_reactor_threads[i], NULL);
+    }
+    if (!m_main_reactor)
+        dump_stats();
+}
+
+void WebServer::dump_stats()
+{
+    char buf[1536];
+    stats::get_instance()->format(buf, sizeof(buf));
+    printf("%s\n", buf);
+    LOG_INFO("%s", buf);
+}
+
+/*-------------------------------------- io_uring后端 ------------------------------------ */
+
+// 事件所属的连接是否仍然存活：代数不同说明fd已被新连接复用，定时器为空说明连接已关闭
+bool WebServer::uring_alive(int sockfd, unsigned gen)
+{
+    conn_slot *c = m_conns->get(sockfd);
+    return c && ((c->http.get_generation() & 0xffffff) == gen) && c->client.timer;
+}
+
+void WebServer::uring_newclient(int res, unsigned flags)
+{
+    // multishot accept出错或被内核终止时不再带IORING_CQE_F_MORE，需要重新提交
+    if (!(flags & IORING_CQE_F_MORE))
+        m_uring->prep_accept_multishot(m_listenfd, uring_data(URING_ACCEPT, m_listenfd, 0));
+
+    if (res < 0)
+    {
+        LOG_ERROR("%s:errno is:%d", "accept error", -res);
+        return;
+    }
+
+    int connfd = res;
+    if (http_conn::m_user_count >= m_max_conn || connfd >= m_conns->max_fd())
+    {
+        utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+    getpeername(connfd, (struct sockaddr *)&client_address, &client_addrlength);
+    add_timer(connfd, client_address);
+
+    m_uring->prep_recv(connfd, uring_data(URING_RECV, connfd, m_conns->get(connfd)->http.get_generation()));
+}
+
+void WebServer::uring_read(int sockfd, unsigned gen, int res, unsigned flags)
+{
+    int bid = -1;
+    if (flags & IORING_CQE_F_BUFFER)
+        bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+    if (!uring_alive(sockfd, gen))
+    {
+        if (bid >= 0)
+            m_uring->recycle_buf(bid);
+        return;
+    }
+
+    conn_slot *c = m_conns->get(sockfd);
+    util_timer *timer = c->client.timer;
+
+    // provided buffer暂时用尽，重新提交recv
+    if (res == -ENOBUFS)
+    {
+        m_uring->prep_recv(sockfd, uring_data(URING_RECV, sockfd, gen));
+        return;
+    }
+    if (res <= 0)
+    {
+        del_timer(timer, sockfd);
+        return;
+    }
+
+    // 读缓冲区已满且其中没有完整的请求，无法继续处理
+    int n = c->http.read_from(m_uring->get_buf(bid), res);
+    if (n == 0)
+    {
+        m_uring->recycle_buf(bid);
+        del_timer(timer, sockfd);
+        return;
+    }
+    if (n < res)
+    {
+        c->held.bid = bid;
+        c->held.offset = n;
+        c->held.len = res - n;
+    }
+    else
+        m_uring->recycle_buf(bid);
+
+    LOG_INFO("deal with the client(%s)", inet_ntoa(c->http.get_address()->sin_addr));
+
+    //将读到的请求放入请求队列，处理完毕后工作线程通过完成队列通知事件循环
+    //先延后定时器：混合模式下请求在本线程处理，处理过程中连接可能已被关闭
+    adjust_timer(timer);
+    if (dispatch(&c->http))
+        uring_processed(sockfd, c->http.get_generation());
+}
+
+// 继续接收连接的数据：先交付上次recv暂存的剩余数据，没有时提交recv
+void WebServer::uring_recv(int sockfd)
+{
+    conn_slot *c = m_conns->get(sockfd);
+    uring_held &held = c->held;
+    if (held.bid < 0)
+    {
+        m_uring->prep_recv(sockfd, uring_data(URING_RECV, sockfd, c->http.get_generation()));
+        return;
+    }
+
+    int n = c->http.read_from(m_uring->get_buf(held.bid) + held.offset, held.len);
+    if (n == 0)
+    {
+        del_timer(c->client.timer, sockfd);
+        return;
+    }
+    held.offset += n;
+    held.len -= n;
+    if (held.len == 0)
+        uring_release(sockfd);
+    if (dispatch(&c->http))
+        uring_processed(sockfd, c->http.get_generation());
+}
+
+void WebServer::uring_release(int sockfd)
+{
+    conn_slot *c = m_conns->get(sockfd);
+    if (!c || c->held.bid < 0)
+        return;
+    m_uring->recycle_buf(c->held.bid);
+    c->held.bid = -1;
+}
+
+// 响应头和文件内容作为链接的两个send一起提交，只在最后一个完成时检查发送结果
+void WebServer::uring_send(int sockfd)
+{
+    conn_slot *c = m_conns->get(sockfd);
+    int count = 0;
+    struct iovec *iv = c->http.get_iovec(count);
+    unsigned gen = c->http.get_generation();
+
+    int last = -1;
+    unsigned segments = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (iv[i].iov_len > 0)
+        {
+            last = i;
+            ++segments;
+        }
+    }
+    // 整条链一次准备完毕，中途提交会把链拆开，提交队列腾不出空间时关闭连接
+    if (!m_uring->reserve(segments))
+    {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        c->http.unmap();
+        del_timer(c->client.timer, sockfd);
+        return;
+    }
+    for (int i = 0; i <= last; ++i)
+    {
+        if (iv[i].iov_len == 0)
+            continue;
+        int op = (i == last) ? URING_SEND_LAST : URING_SEND;
+        m_uring->prep_send(sockfd, iv[i].iov_base, iv[i].iov_len, uring_data(op, sockfd, gen), i != last);
+    }
+}
+
+void WebServer::uring_write(int sockfd, unsigned gen, int op, int res)
+{
+    if (!uring_alive(sockfd, gen))
+        return;
+
+    conn_slot *c = m_conns->get(sockfd);
+    if (res > 0)
+        c->http.consume_iv(res);
+
+    // 前一环发送不完整时后一环会以-ECANCELED完成，统一由最后一环根据剩余字节数决定是否重新提交
+    if (URING_SEND == op)
+        return;
+
+    util_timer *timer = c->client.timer;
+    if (res < 0 && res != -ECANCELED)
+    {
+        c->http.unmap();
+        del_timer(timer, sockfd);
+        return;
+    }
+
+    if (c->http.has_pending_write())
+    {
+        uring_send(sockfd);
+    }
+    else if (c->http.finish_write())
+    {
+        LOG_INFO("send data to the client(%s)", inet_ntoa(c->http.get_address()->sin_addr));
+        // 先延后定时器，继续处理或接收的过程中连接可能被关闭
+        adjust_timer(timer);
+        // 读缓冲区中还有流水线请求时交给工作线程继续处理，否则继续接收
+        if (c->http.has_pending_request())
+        {
+            if (dispatch(&c->http))
+                uring_processed(sockfd, c->http.get_generation());
+        }
+        else
+            uring_recv(sockfd);
+        return;
+    }
+    else
+    {
+        del_timer(timer, sockfd);
+        return;
+    }
+    adjust_timer(timer);
+}
+
+void WebServer::uring_completion()
+{
+    m_completion->reap(m_completions);
+    for (size_t i = 0; i < m_completions.size(); ++i)
+        uring_processed(m_completions[i].sockfd, m_completions[i].generation);
+    m_completions.clear();
+}
+
+// 请求处理完毕(由工作线程或混合模式下由事件循环本身)：有响应则提交send，请求不完整则继续提交recv。
+// generation为处理的请求所属连接的代数
+void WebServer::uring_processed(int sockfd, unsigned int generation)
+{
+    // 处理过程中已关闭该连接，或fd已属于新连接(工作线程的完成记录晚于关闭到达)
+    conn_slot *c = m_conns->get(sockfd);
+    if (!c || !c->client.timer || c->http.get_generation() != generation)
+        return;
+
+    if (c->http.has_pending_write())
+        uring_send(sockfd);
+    else
+        uring_recv(sockfd);
+}
+
+void WebServer::uringLoop()
+{
+    bool timeout = false;
+    bool stop_server = false;
+
+    m_uring->prep_accept_multishot(m_listenfd, uring_data(URING_ACCEPT, m_listenfd, 0));
+    m_uring->prep_poll_multishot(m_pipefd[0], uring_data(URING_SIGNAL, m_pipefd[0], 0));
+    m_uring->prep_poll_multishot(utils.m_timerfd, uring_data(URING_TIMER, utils.m_timerfd, 0));
+    m_uring->prep_poll_multishot(m_completion->get_eventfd(), uring_data(URING_COMPLETION, 0, 0));
+
+    while (!stop_server)
+    {
+        // 一次系统调用同时提交上一轮积累的全部SQE，并等待新的完成事件
+        int ret = m_uring->submit_and_wait(1);
+        if (ret < 0 && ret != -EINTR)
+        {
+            LOG_ERROR("%s", "io_uring failure");
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while (m_uring->peek_cqe(&cqe))
+        {
+            uint64_t data  = cqe->user_data;
+            int      res   = cqe->res;
+            unsigned flags = cqe->flags;
+            m_uring->cqe_seen();
+
+            int      op     = data >> 56;
+            unsigned gen    = (data >> 32) & 0xffffff;
+            int      sockfd = (int)(uint32_t)data;
+            switch (op)
+            {
+            case URING_ACCEPT:
+                uring_newclient(res, flags);
+                break;
+            case URING_SIGNAL:
+            {
+                if (!(flags & IORING_CQE_F_MORE))
+                    m_uring->prep_poll_multishot(m_pipefd[0], data);
+                bool flag = dealwith_signal(stop_server);
+                if (false == flag)
+                    LOG_ERROR("%s", "dealclientdata failure");
+                break;
+            }
+            case URING_TIMER:
+                if (!(flags & IORING_CQE_F_MORE))
+                    m_uring->prep_poll_multishot(utils.m_timerfd, data);
+                timeout = true;
+                break;
+            case URING_COMPLETION:
+                if (!(flags & IORING_CQE_F_MORE))
+                    m_uring->prep_poll_multishot(m_completion->get_eventfd(), data);
+                uring_completion();
+                break;
+            case URING_RECV:
+                uring_read(sockfd, gen, res, flags);
+                break;
+            case URING_SEND:
+            case URING_SEND_LAST:
+                uring_write(sockfd, gen, op, res);
+                break;
+            case URING_CLOSE:
+                // 连接暂存的缓冲区已在uring_cb_func中归还，此时fd可能已被新连接复用
+                break;
+            default:
+                break;
+            }
+        }
+
         if (timeout)
         {
             utils.timer_handler();
             LOG_INFO("%s", "timer tick");
             timeout = false;
         }
+        utils.rearm_timer();
     }
+    dump_stats();
 }
\ No newline at end of file
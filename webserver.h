@@ -11,13 +11,21 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <sys/resource.h>
+#include <climits>
+#include <vector>
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./http/conn_table.h"
+#include "./uring/uring.h"
+#include "./cache/file_cache.h"
 
-const int MAX_FD = 65536;           //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; //最大事件数
-const int TIMESLOT = 5;             //最小超时单位
+const int IDLE_TIMEOUT = 15000;     //默认的非活动连接超时时间(ms)
+const int FILE_CACHE_NUM = 256;     //默认缓存的最大文件数
+const long long FILE_CACHE_BYTES = 64 * 1024 * 1024; //文件缓存的总字节数上限
+const int RESPONSE_CACHE_SIZE = 16 * 1024; //不超过该大小的文件缓存完整响应
 
 class WebServer
 {
@@ -27,12 +35,19 @@ public:
 
     void init(int port , string user, string passWord, string databaseName,
               int log_write , int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int reactor_num = 0,
+              int event_backend = 0, int idle_timeout = IDLE_TIMEOUT, int zero_copy = 0,
+              int file_cache = FILE_CACHE_NUM, int max_conn = 0, int work_steal = 0,
+              int max_thread = 0, int db_thread = 0, int hybrid = 0, int persist = 0,
+              int async_sql = 0, int affine_sql = 0, int sql_min = 0);
 
     void thread_pool();
     void sql_pool();
     void log_write();
     void trig_mode();
+    void event_backend();
+    void cache();
+    void connections();
 
     void eventListen();
     void eventLoop();
@@ -40,6 +55,14 @@ public:
     void run();
 
 private:
+    // 多Reactor模式(one loop per thread)：从Reactor与主Reactor共享连接表和线程池，
+    // 但独占epoll内核事件表、SO_REUSEPORT监听socket、信号管道和定时器链表
+    WebServer(WebServer *main_reactor);
+    void sub_reactor();
+    static void *sub_reactor_worker(void *arg);
+    void forward_signal(const char *signals, int len);
+
+
 // 供deal函数调用的操作timer的私有函数
     // 调整定时器的相关函数
     void add_timer(int connfd, struct sockaddr_in client_address);
@@ -47,9 +70,26 @@ private:
     void del_timer(util_timer *timer, int sockfd);
 //
     bool deal_newclient();
-    bool dealwith_signal(bool& timeout, bool& stop_server);
+    bool dealwith_signal(bool& stop_server);
     void dealwith_read(int sockfd);
     void dealwith_write(int sockfd);
+    void dealwith_event(int sockfd, uint32_t events);
+    void dealwith_completion();
+    bool dispatch(http_conn *request);
+    static void sql_resume(http_conn *request, unsigned int generation, void *arg);
+    void dump_stats();
+
+    // io_uring后端：事件循环及各类完成事件的处理
+    void uringLoop();
+    void uring_newclient(int res, unsigned flags);
+    void uring_read(int sockfd, unsigned gen, int res, unsigned flags);
+    void uring_write(int sockfd, unsigned gen, int op, int res);
+    void uring_completion();
+    void uring_processed(int sockfd, unsigned int generation);
+    void uring_send(int sockfd);
+    void uring_recv(int sockfd);
+    void uring_release(int sockfd);
+    bool uring_alive(int sockfd, unsigned gen);
 
 public:
     //基础
@@ -58,10 +98,28 @@ public:
     int   m_log_write;
     int   m_close_log;
     int   m_actormodel;
+    int   m_reactor_num;
+    int   m_event_backend;
+    int   m_idle_timeout;   // 非活动连接超时时间(ms)
+    int   m_zero_copy;      // 是否用sendfile发送文件
+    int   m_file_cache;     // 文件缓存的最大文件数，0为不缓存
+    int   m_max_conn;       // 最大连接数，0为不超过进程的fd上限
+    int   m_work_steal;     // 线程池是否使用每线程队列加工作窃取
+    int   m_max_thread;     // 线程池最大线程数，不大于m_thread_num时线程数固定
+    int   m_db_thread;      // 同时处理数据库请求的最大线程数，0为不分通道
+    int   m_hybrid;         // Proactor模式下是否在Reactor线程上直接处理能快速完成的静态请求
+    int   m_persist;        // 连接所有权模式：事件在accept时一次注册，不再逐次重新注册
+    int   m_async_sql;      // 注册请求的数据库查询由查询线程非阻塞执行，工作线程不等待
+    int   m_affine_sql;     // 数据库连接由工作线程独占，取用、归还不需要同步
+
+    //多Reactor相关
+    WebServer*              m_main_reactor;   // 从Reactor指向主Reactor，主Reactor为NULL
+    std::vector<WebServer*> m_sub_reactors;
+    std::vector<pthread_t>  m_reactor_threads;
 
     int        m_pipefd[2];
     int        m_epollfd;
-    http_conn* users;       // 存放http_conn对象的数组，内部对象会被append进线程池m_pool中
+    conn_table* m_conns;    // 连接表，其中的http_conn对象会被append进线程池m_pool中
 
     //数据库相关
     sql_connection_pool* m_sqlConnPool;
@@ -69,22 +127,27 @@ public:
     string               m_passWord;     //登陆数据库密码
     string               m_databaseName; //使用数据库名
     int                  m_sql_num;
+    int                  m_sql_min;      //最少保持的连接数，0为与m_sql_num相同
 
     //线程池相关
-    threadpool<http_conn>* m_threadPool;
-    int                    m_thread_num;
+    threadpool<http_conn>*  m_threadPool;
+    int                     m_thread_num;
+    completion_queue*       m_completion;   // Reactor模式下工作线程汇报读写结果，所有权模式下持有者提交关闭记录
+    std::vector<completion> m_completions;  // 每轮从完成队列中批量取出的记录
 
     //epoll_event相关
     epoll_event events[MAX_EVENT_NUMBER];
 
+    //io_uring相关，为NULL时使用epoll
+    uring* m_uring;
+
     int m_listenfd;
     int m_OPT_LINGER;
     int m_TRIGMode;
     int m_LISTENTrigmode;
     int m_CONNTrigmode;
 
-    //定时器相关(定时器用来处理非活动链接)
-    client_data* users_timer;
+    //定时器相关(定时器用来处理非活动链接)，连接的定时器内嵌在连接表中
     Utils        utils; // 这应放入一个命名空间
 };
 #endif